@@ -0,0 +1,389 @@
+/*
+ * bcheck - Check the bits.c puzzles exhaustively against reference
+ *          implementations and report what each one costs per call.
+ *
+ * Build it with the puzzles and their batch versions:
+ *
+ *     gcc -O2 -pthread -o bcheck bcheck.c bits_batch.c bits.c
+ *
+ * Every 32-bit argument is tried, split across threads in chunks. The
+ * float puzzles are checked against the FPU, the integer ones against
+ * plain C expressions. getByte gets every x with each byte index 0..3;
+ * bitAnd pairs every x with a bijective mix of it, so each y value is
+ * seen once too.
+ *
+ * Each puzzle runs once per implementation: "call" calls the bits.c
+ * function per element, the rest are the bits_batch.h kernels for that
+ * instruction set. ns/op is the time spent inside the puzzle alone, per
+ * element per thread; the reference and the comparison are not counted.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+#include "bits_batch.h"
+
+#define CHUNK_BITS 16                   /* inputs per chunk, log2 */
+#define CHUNK      (1u << CHUNK_BITS)
+#define MAXSHOW    64                   /* most mismatches kept */
+#define MAXTHREADS 256
+
+/* The puzzles, from bits.c */
+int bitAnd(int x, int y);
+int getByte(int x, int n);
+int bang(int x);
+int tmin(void);
+int negate(int x);
+int isPositive(int x);
+unsigned float_neg(unsigned uf);
+unsigned float_twice(unsigned uf);
+
+typedef void (*run_fn)(const unsigned *x, const unsigned *y, unsigned *out, size_t n);
+
+typedef struct {
+    const char *name;
+    int passes;                 /* sweeps over x; y comes from the pass */
+    int args;                   /* arguments shown in a mismatch */
+    run_fn call;                /* one bits.c call per element */
+    run_fn batch;               /* the *_n kernel */
+    unsigned (*ref)(unsigned x, unsigned y);
+    unsigned (*arg)(unsigned x, int pass);   /* second argument */
+} test_t;
+
+typedef struct {
+    unsigned x, y, got, want;
+    uint64_t order;             /* pass and x, for picking the first ones */
+} miss_t;
+
+/* Shared by the threads of one run */
+static const test_t *cur;
+static run_fn cur_run;
+static uint64_t nchunks;
+static uint64_t next_chunk;
+static uint64_t nmiss;
+static uint64_t fn_ns;
+static miss_t misses[MAXSHOW];
+static int nshow;
+static int maxshow = 4;
+static int inbits = 32;         /* log2 of the x values tried */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *worker(void *arg);
+static void record(unsigned x, unsigned y, unsigned got, unsigned want, uint64_t order);
+static int run_test(const test_t *t, const char *impl, run_fn run, int nthreads);
+static uint64_t now_ns(void);
+void usage(void);
+void unix_error(char *msg);
+void app_error(char *msg);
+
+/*
+ * Second arguments
+ */
+static unsigned arg_none(unsigned x, int pass) { (void)x; (void)pass; return 0; }
+static unsigned arg_byte(unsigned x, int pass) { (void)x; return pass; }
+static unsigned arg_mix(unsigned x, int pass)
+{
+    (void)pass;
+    x *= 0x9e3779b1u;           /* odd, so x -> y is one to one */
+    return x ^ (x >> 16);
+}
+
+/*
+ * References
+ */
+static unsigned f2u(float f) { unsigned u; memcpy(&u, &f, sizeof(u)); return u; }
+static float u2f(unsigned u) { float f; memcpy(&f, &u, sizeof(f)); return f; }
+
+static unsigned ref_bitAnd(unsigned x, unsigned y) { return x & y; }
+static unsigned ref_getByte(unsigned x, unsigned n) { return (x >> (n * 8)) & 0xff; }
+static unsigned ref_bang(unsigned x, unsigned y) { (void)y; return x == 0; }
+static unsigned ref_negate(unsigned x, unsigned y) { (void)y; return 0u - x; }
+static unsigned ref_isPositive(unsigned x, unsigned y) { (void)y; return (int)x > 0; }
+
+/* NaN comes back unchanged, as the puzzles specify */
+static unsigned ref_float_neg(unsigned uf, unsigned y)
+{
+    (void)y;
+    return isnan(u2f(uf)) ? uf : f2u(-u2f(uf));
+}
+
+static unsigned ref_float_twice(unsigned uf, unsigned y)
+{
+    (void)y;
+    return isnan(u2f(uf)) ? uf : f2u(2.0f * u2f(uf));
+}
+
+/*
+ * Per-element calls into bits.c
+ */
+#define CALL1(fn, T)                                                        \
+static void call_##fn(const unsigned *x, const unsigned *y, unsigned *out, size_t n) \
+{                                                                           \
+    size_t i;                                                               \
+    (void)y;                                                                \
+    for (i = 0; i < n; i++)                                                 \
+        out[i] = fn((T)x[i]);                                               \
+}
+#define CALL2(fn)                                                           \
+static void call_##fn(const unsigned *x, const unsigned *y, unsigned *out, size_t n) \
+{                                                                           \
+    size_t i;                                                               \
+    for (i = 0; i < n; i++)                                                 \
+        out[i] = fn((int)x[i], (int)y[i]);                                  \
+}
+CALL2(bitAnd)
+CALL2(getByte)
+CALL1(bang, int)
+CALL1(negate, int)
+CALL1(isPositive, int)
+CALL1(float_neg, unsigned)
+CALL1(float_twice, unsigned)
+
+/*
+ * The batch kernels, on unsigned arrays
+ */
+#define BATCH1(fn, T)                                                       \
+static void batch_##fn(const unsigned *x, const unsigned *y, unsigned *out, size_t n) \
+{                                                                           \
+    (void)y;                                                                \
+    fn##_n((const T *)x, (T *)out, n);                                      \
+}
+#define BATCH2(fn)                                                          \
+static void batch_##fn(const unsigned *x, const unsigned *y, unsigned *out, size_t n) \
+{                                                                           \
+    fn##_n((const int *)x, (const int *)y, (int *)out, n);                  \
+}
+BATCH2(bitAnd)
+BATCH2(getByte)
+BATCH1(bang, int)
+BATCH1(negate, int)
+BATCH1(isPositive, int)
+BATCH1(float_neg, unsigned)
+BATCH1(float_twice, unsigned)
+
+static const test_t tests[] = {
+    { "bitAnd", 1, 2, call_bitAnd, batch_bitAnd, ref_bitAnd, arg_mix },
+    { "getByte", 4, 2, call_getByte, batch_getByte, ref_getByte, arg_byte },
+    { "bang", 1, 1, call_bang, batch_bang, ref_bang, arg_none },
+    { "negate", 1, 1, call_negate, batch_negate, ref_negate, arg_none },
+    { "isPositive", 1, 1, call_isPositive, batch_isPositive, ref_isPositive, arg_none },
+    { "float_neg", 1, 1, call_float_neg, batch_float_neg, ref_float_neg, arg_none },
+    { "float_twice", 1, 1, call_float_twice, batch_float_twice, ref_float_twice, arg_none },
+};
+#define NTESTS (sizeof(tests) / sizeof(tests[0]))
+
+static const char *isas[] = { "scalar", "sse2", "avx2", "neon" };
+#define NISAS (sizeof(isas) / sizeof(isas[0]))
+
+/*
+ * main - Run the chosen puzzles over every input with each implementation
+ */
+int main(int argc, char **argv)
+{
+    int c, bad = 0, nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *func = NULL, *impl = NULL;
+    size_t i, j;
+
+    while ((c = getopt(argc, argv, "hf:i:t:m:n:")) != EOF) {
+	switch (c) {
+	case 'h':             /* print help message */
+	    usage();
+	    break;
+	case 'f':             /* only this puzzle */
+	    func = optarg;
+	    break;
+	case 'i':             /* only this implementation */
+	    impl = optarg;
+	    break;
+	case 't':             /* worker threads */
+	    nthreads = atoi(optarg);
+	    break;
+	case 'm':             /* mismatches to print per run */
+	    maxshow = atoi(optarg);
+	    break;
+	case 'n':             /* try only the low n bits of x */
+	    inbits = atoi(optarg);
+	    break;
+	default:
+	    usage();
+	}
+    }
+    if (optind != argc || nthreads < 1 || maxshow < 0 || maxshow > MAXSHOW ||
+	inbits < CHUNK_BITS || inbits > 32)
+	usage();
+    if (nthreads > MAXTHREADS)
+	nthreads = MAXTHREADS;
+
+    if (tmin() != (int)0x80000000) {
+	printf("tmin() = 0x%x, expected 0x80000000\n", tmin());
+	bad = 1;
+    }
+
+    printf("%-12s %-7s %12s %10s %9s %9s\n", "function", "impl", "inputs",
+	   "errors", "ns/op", "Mops/s");
+    for (i = 0; i < NTESTS; i++) {
+	if (func && strcmp(func, tests[i].name))
+	    continue;
+	if (!impl || !strcmp(impl, "call"))
+	    bad |= run_test(&tests[i], "call", tests[i].call, nthreads);
+	for (j = 0; j < NISAS; j++) {
+	    if ((impl && strcmp(impl, isas[j])) || !bits_batch_use(isas[j]))
+		continue;
+	    bad |= run_test(&tests[i], isas[j], tests[i].batch, nthreads);
+	}
+    }
+    return bad;
+}
+
+/*
+ * run_test - Sweep one puzzle through one implementation on nthreads
+ *            threads; returns 1 if any result was wrong
+ */
+static int run_test(const test_t *t, const char *impl, run_fn run, int nthreads)
+{
+    pthread_t tid[MAXTHREADS];
+    uint64_t start, wall, inputs;
+    int i;
+
+    cur = t;
+    cur_run = run;
+    nchunks = (uint64_t)t->passes << (inbits - CHUNK_BITS);
+    next_chunk = 0;
+    nmiss = 0;
+    fn_ns = 0;
+    nshow = 0;
+
+    start = now_ns();
+    for (i = 0; i < nthreads; i++)
+	if (pthread_create(&tid[i], NULL, worker, NULL) != 0)
+	    app_error("pthread_create failed");
+    for (i = 0; i < nthreads; i++)
+	pthread_join(tid[i], NULL);
+    wall = now_ns() - start;
+
+    inputs = nchunks * CHUNK;
+    printf("%-12s %-7s %12llu %10llu %9.3f %9.1f\n", t->name, impl,
+	   (unsigned long long)inputs, (unsigned long long)nmiss,
+	   (double)fn_ns / inputs, inputs * 1e3 / wall);
+    for (i = 0; i < nshow; i++) {
+	if (t->args == 2)
+	    printf("    %s(0x%x, 0x%x) = 0x%x, expected 0x%x\n", t->name,
+		   misses[i].x, misses[i].y, misses[i].got, misses[i].want);
+	else
+	    printf("    %s(0x%x) = 0x%x, expected 0x%x\n", t->name,
+		   misses[i].x, misses[i].got, misses[i].want);
+    }
+    return nmiss != 0;
+}
+
+/*
+ * worker - Take chunks until none are left, timing only the puzzle
+ */
+static void *worker(void *arg)
+{
+    unsigned *x, *y, *out;
+    uint64_t c, t0, ns = 0, order;
+    unsigned base, i, want;
+    int pass;
+
+    (void)arg;
+    if ((x = malloc(3 * CHUNK * sizeof(unsigned))) == NULL)
+	unix_error("malloc");
+    y = x + CHUNK;
+    out = y + CHUNK;
+
+    while ((c = __atomic_fetch_add(&next_chunk, 1, __ATOMIC_RELAXED)) < nchunks) {
+	pass = c >> (inbits - CHUNK_BITS);
+	base = (unsigned)(c & ((1ull << (inbits - CHUNK_BITS)) - 1)) << CHUNK_BITS;
+	for (i = 0; i < CHUNK; i++) {
+	    x[i] = base + i;
+	    y[i] = cur->arg(x[i], pass);
+	}
+
+	t0 = now_ns();
+	cur_run(x, y, out, CHUNK);
+	ns += now_ns() - t0;
+
+	for (i = 0; i < CHUNK; i++) {
+	    want = cur->ref(x[i], y[i]);
+	    if (out[i] != want) {
+		order = (uint64_t)pass << 32 | x[i];
+		record(x[i], y[i], out[i], want, order);
+	    }
+	}
+    }
+
+    __atomic_fetch_add(&fn_ns, ns, __ATOMIC_RELAXED);
+    free(x);
+    return NULL;
+}
+
+/*
+ * record - Count a mismatch, keeping the maxshow lowest by pass and x
+ */
+static void record(unsigned x, unsigned y, unsigned got, unsigned want, uint64_t order)
+{
+    int i;
+
+    pthread_mutex_lock(&lock);
+    nmiss++;
+    if (nshow < maxshow || (nshow > 0 && order < misses[nshow - 1].order)) {
+	i = nshow < maxshow ? nshow++ : nshow - 1;
+	for (; i > 0 && misses[i - 1].order > order; i--)
+	    misses[i] = misses[i - 1];
+	misses[i].x = x;
+	misses[i].y = y;
+	misses[i].got = got;
+	misses[i].want = want;
+	misses[i].order = order;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * now_ns - Monotonic clock in nanoseconds
+ */
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/*
+ * usage - print a help message
+ */
+void usage(void)
+{
+    printf("Usage: bcheck [-h] [-f func] [-i impl] [-t threads] [-m shown] [-n bits]\n");
+    printf("   -h          print this message\n");
+    printf("   -f func     check only this puzzle\n");
+    printf("   -i impl     only call, scalar, sse2, avx2 or neon\n");
+    printf("   -t threads  worker threads (default: one per CPU)\n");
+    printf("   -m shown    mismatches printed per run (default 4, max %d)\n", MAXSHOW);
+    printf("   -n bits     try x below 2^bits only, %d..32 (default 32)\n", CHUNK_BITS);
+    exit(1);
+}
+
+/*
+ * unix_error - unix-style error routine
+ */
+void unix_error(char *msg)
+{
+    perror(msg);
+    exit(1);
+}
+
+/*
+ * app_error - application-style error routine
+ */
+void app_error(char *msg)
+{
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
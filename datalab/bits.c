@@ -264,9 +264,9 @@ unsigned float_neg(unsigned uf) {
  */
 unsigned float_twice(unsigned uf) {
   unsigned exp = 0x7f800000 & uf;
-  unsigned frac = 0x007fffff & uf;
   unsigned sign = 0x80000000 & uf;
-  if (exp == 0x7f80000) return uf; //inf or nan
+  if (exp == 0x7f800000) return uf; //inf or nan
   else if (exp == 0) return sign | (uf << 1); //denormal
+  else if (exp == 0x7f000000) return sign | 0x7f800000; //overflows to inf
   else return uf + 0x00800000;
 }
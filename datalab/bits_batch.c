@@ -0,0 +1,402 @@
+/*
+ * bits_batch.c - Array versions of the bits.c puzzles, with SSE2, AVX2
+ *                and NEON kernels picked at run time
+ *
+ * This file is not part of the hand-in and is free of the coding rules.
+ * Link it with bits.c, whose scalar functions handle the elements left
+ * over after the last full vector and serve CPUs with no vector unit:
+ *
+ *     gcc -O2 -c bits_batch.c bits.c
+ *
+ * The AVX2 kernels are compiled through a target attribute, so no
+ * -mavx2 is needed; they are only called if the CPU has AVX2.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "bits_batch.h"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define BATCH_X86
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define BATCH_NEON
+#include <arm_neon.h>
+#endif
+
+/* The scalar puzzles, from bits.c */
+int bitAnd(int x, int y);
+int getByte(int x, int n);
+int bang(int x);
+int negate(int x);
+int isPositive(int x);
+unsigned float_neg(unsigned uf);
+unsigned float_twice(unsigned uf);
+
+/* The kernels for one instruction set */
+struct kernels {
+    const char *name;
+    int (*supported)(void);
+    void (*bitAnd)(const int *, const int *, int *, size_t);
+    void (*getByte)(const int *, const int *, int *, size_t);
+    void (*bang)(const int *, int *, size_t);
+    void (*negate)(const int *, int *, size_t);
+    void (*isPositive)(const int *, int *, size_t);
+    void (*float_neg)(const unsigned *, unsigned *, size_t);
+    void (*float_twice)(const unsigned *, unsigned *, size_t);
+};
+
+/*
+ * KERNEL1 and KERNEL2 define isa's array kernel for a one- or
+ * two-argument puzzle: W lanes at a time through OP on vectors of type
+ * V, then the scalar puzzle for the rest
+ */
+#define KERNEL1(isa, fn, T, V, W, LOAD, STORE, OP)                   \
+static void fn##_##isa(const T *in, T *out, size_t n)                \
+{                                                                    \
+    size_t i = 0;                                                    \
+    for (; i + (W) <= n; i += (W))                                   \
+        STORE(out + i, OP(LOAD(in + i)));                            \
+    for (; i < n; i++)                                               \
+        out[i] = fn(in[i]);                                          \
+}
+#define KERNEL2(isa, fn, T, V, W, LOAD, STORE, OP)                   \
+static void fn##_##isa(const T *x, const T *y, T *out, size_t n)     \
+{                                                                    \
+    size_t i = 0;                                                    \
+    for (; i + (W) <= n; i += (W))                                   \
+        STORE(out + i, OP(LOAD(x + i), LOAD(y + i)));                \
+    for (; i < n; i++)                                               \
+        out[i] = fn(x[i], y[i]);                                     \
+}
+
+/*
+ * Scalar
+ */
+static int scalar_supported(void) { return 1; }
+#define SCALAR_LOAD(p)     (*(p))
+#define SCALAR_STORE(p, v) (*(p) = (v))
+KERNEL2(scalar, bitAnd, int, int, 1, SCALAR_LOAD, SCALAR_STORE, bitAnd)
+KERNEL2(scalar, getByte, int, int, 1, SCALAR_LOAD, SCALAR_STORE, getByte)
+KERNEL1(scalar, bang, int, int, 1, SCALAR_LOAD, SCALAR_STORE, bang)
+KERNEL1(scalar, negate, int, int, 1, SCALAR_LOAD, SCALAR_STORE, negate)
+KERNEL1(scalar, isPositive, int, int, 1, SCALAR_LOAD, SCALAR_STORE, isPositive)
+KERNEL1(scalar, float_neg, unsigned, unsigned, 1, SCALAR_LOAD, SCALAR_STORE, float_neg)
+KERNEL1(scalar, float_twice, unsigned, unsigned, 1, SCALAR_LOAD, SCALAR_STORE, float_twice)
+
+static const struct kernels scalar_kernels = {
+    "scalar", scalar_supported,
+    bitAnd_scalar, getByte_scalar, bang_scalar, negate_scalar,
+    isPositive_scalar, float_neg_scalar, float_twice_scalar
+};
+
+#ifdef BATCH_X86
+/*
+ * SSE2, 4 lanes. Every x86-64 CPU has it.
+ */
+#define SSE_LOAD(p)     _mm_loadu_si128((const __m128i *)(p))
+#define SSE_STORE(p, v) _mm_storeu_si128((__m128i *)(p), (v))
+#define SSE_SEL(m, a, b) _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b))
+
+static int sse2_supported(void) { return 1; }
+
+static inline __m128i sse2_bitAnd(__m128i x, __m128i y)
+{
+    return _mm_and_si128(x, y);
+}
+
+/* no per-lane shifts before AVX2: pick among the four byte shifts */
+static inline __m128i sse2_getByte(__m128i x, __m128i n)
+{
+    __m128i r = x;
+    r = SSE_SEL(_mm_cmpeq_epi32(n, _mm_set1_epi32(1)), _mm_srli_epi32(x, 8), r);
+    r = SSE_SEL(_mm_cmpeq_epi32(n, _mm_set1_epi32(2)), _mm_srli_epi32(x, 16), r);
+    r = SSE_SEL(_mm_cmpeq_epi32(n, _mm_set1_epi32(3)), _mm_srli_epi32(x, 24), r);
+    return _mm_and_si128(r, _mm_set1_epi32(0xff));
+}
+
+static inline __m128i sse2_bang(__m128i x)
+{
+    return _mm_and_si128(_mm_cmpeq_epi32(x, _mm_setzero_si128()), _mm_set1_epi32(1));
+}
+
+static inline __m128i sse2_negate(__m128i x)
+{
+    return _mm_sub_epi32(_mm_setzero_si128(), x);
+}
+
+static inline __m128i sse2_isPositive(__m128i x)
+{
+    return _mm_and_si128(_mm_cmpgt_epi32(x, _mm_setzero_si128()), _mm_set1_epi32(1));
+}
+
+/* NaN: |uf| above the infinity pattern (a signed compare is fine on |uf|) */
+static inline __m128i sse2_float_neg(__m128i uf)
+{
+    __m128i sign = _mm_set1_epi32(0x80000000);
+    __m128i nan = _mm_cmpgt_epi32(_mm_andnot_si128(sign, uf), _mm_set1_epi32(0x7f800000));
+    return _mm_xor_si128(uf, _mm_andnot_si128(nan, sign));
+}
+
+static inline __m128i sse2_float_twice(__m128i uf)
+{
+    __m128i exp = _mm_and_si128(uf, _mm_set1_epi32(0x7f800000));
+    __m128i sign = _mm_and_si128(uf, _mm_set1_epi32(0x80000000));
+    __m128i r = _mm_add_epi32(uf, _mm_set1_epi32(0x00800000));
+    r = SSE_SEL(_mm_cmpeq_epi32(exp, _mm_set1_epi32(0x7f000000)),
+                _mm_or_si128(sign, _mm_set1_epi32(0x7f800000)), r);
+    r = SSE_SEL(_mm_cmpeq_epi32(exp, _mm_setzero_si128()),
+                _mm_or_si128(sign, _mm_slli_epi32(uf, 1)), r);
+    return SSE_SEL(_mm_cmpeq_epi32(exp, _mm_set1_epi32(0x7f800000)), uf, r);
+}
+
+KERNEL2(sse2, bitAnd, int, __m128i, 4, SSE_LOAD, SSE_STORE, sse2_bitAnd)
+KERNEL2(sse2, getByte, int, __m128i, 4, SSE_LOAD, SSE_STORE, sse2_getByte)
+KERNEL1(sse2, bang, int, __m128i, 4, SSE_LOAD, SSE_STORE, sse2_bang)
+KERNEL1(sse2, negate, int, __m128i, 4, SSE_LOAD, SSE_STORE, sse2_negate)
+KERNEL1(sse2, isPositive, int, __m128i, 4, SSE_LOAD, SSE_STORE, sse2_isPositive)
+KERNEL1(sse2, float_neg, unsigned, __m128i, 4, SSE_LOAD, SSE_STORE, sse2_float_neg)
+KERNEL1(sse2, float_twice, unsigned, __m128i, 4, SSE_LOAD, SSE_STORE, sse2_float_twice)
+
+static const struct kernels sse2_kernels = {
+    "sse2", sse2_supported,
+    bitAnd_sse2, getByte_sse2, bang_sse2, negate_sse2,
+    isPositive_sse2, float_neg_sse2, float_twice_sse2
+};
+
+/*
+ * AVX2, 8 lanes
+ */
+#define AVX2 __attribute__((target("avx2")))
+#define AVX_LOAD(p)     _mm256_loadu_si256((const __m256i *)(p))
+#define AVX_STORE(p, v) _mm256_storeu_si256((__m256i *)(p), (v))
+
+static int avx2_supported(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+static inline AVX2 __m256i avx2_bitAnd(__m256i x, __m256i y)
+{
+    return _mm256_and_si256(x, y);
+}
+
+static inline AVX2 __m256i avx2_getByte(__m256i x, __m256i n)
+{
+    return _mm256_and_si256(_mm256_srlv_epi32(x, _mm256_slli_epi32(n, 3)),
+                            _mm256_set1_epi32(0xff));
+}
+
+static inline AVX2 __m256i avx2_bang(__m256i x)
+{
+    return _mm256_and_si256(_mm256_cmpeq_epi32(x, _mm256_setzero_si256()),
+                            _mm256_set1_epi32(1));
+}
+
+static inline AVX2 __m256i avx2_negate(__m256i x)
+{
+    return _mm256_sub_epi32(_mm256_setzero_si256(), x);
+}
+
+static inline AVX2 __m256i avx2_isPositive(__m256i x)
+{
+    return _mm256_and_si256(_mm256_cmpgt_epi32(x, _mm256_setzero_si256()),
+                            _mm256_set1_epi32(1));
+}
+
+static inline AVX2 __m256i avx2_float_neg(__m256i uf)
+{
+    __m256i sign = _mm256_set1_epi32(0x80000000);
+    __m256i nan = _mm256_cmpgt_epi32(_mm256_andnot_si256(sign, uf),
+                                     _mm256_set1_epi32(0x7f800000));
+    return _mm256_xor_si256(uf, _mm256_andnot_si256(nan, sign));
+}
+
+static inline AVX2 __m256i avx2_float_twice(__m256i uf)
+{
+    __m256i exp = _mm256_and_si256(uf, _mm256_set1_epi32(0x7f800000));
+    __m256i sign = _mm256_and_si256(uf, _mm256_set1_epi32(0x80000000));
+    __m256i r = _mm256_add_epi32(uf, _mm256_set1_epi32(0x00800000));
+    r = _mm256_blendv_epi8(r, _mm256_or_si256(sign, _mm256_set1_epi32(0x7f800000)),
+                           _mm256_cmpeq_epi32(exp, _mm256_set1_epi32(0x7f000000)));
+    r = _mm256_blendv_epi8(r, _mm256_or_si256(sign, _mm256_slli_epi32(uf, 1)),
+                           _mm256_cmpeq_epi32(exp, _mm256_setzero_si256()));
+    return _mm256_blendv_epi8(r, uf, _mm256_cmpeq_epi32(exp, _mm256_set1_epi32(0x7f800000)));
+}
+
+#define AVX_KERNEL1(fn, T, OP) AVX2 KERNEL1(avx2, fn, T, __m256i, 8, AVX_LOAD, AVX_STORE, OP)
+#define AVX_KERNEL2(fn, T, OP) AVX2 KERNEL2(avx2, fn, T, __m256i, 8, AVX_LOAD, AVX_STORE, OP)
+AVX_KERNEL2(bitAnd, int, avx2_bitAnd)
+AVX_KERNEL2(getByte, int, avx2_getByte)
+AVX_KERNEL1(bang, int, avx2_bang)
+AVX_KERNEL1(negate, int, avx2_negate)
+AVX_KERNEL1(isPositive, int, avx2_isPositive)
+AVX_KERNEL1(float_neg, unsigned, avx2_float_neg)
+AVX_KERNEL1(float_twice, unsigned, avx2_float_twice)
+
+static const struct kernels avx2_kernels = {
+    "avx2", avx2_supported,
+    bitAnd_avx2, getByte_avx2, bang_avx2, negate_avx2,
+    isPositive_avx2, float_neg_avx2, float_twice_avx2
+};
+#endif /* BATCH_X86 */
+
+#ifdef BATCH_NEON
+/*
+ * NEON, 4 lanes. Every AArch64 CPU has it.
+ */
+#define NEON_LOAD(p)     vld1q_s32((const int *)(p))
+#define NEON_STORE(p, v) vst1q_s32((int *)(p), (v))
+#define U(v) vreinterpretq_u32_s32(v)
+#define S(v) vreinterpretq_s32_u32(v)
+
+static int neon_supported(void) { return 1; }
+
+static inline int32x4_t neon_bitAnd(int32x4_t x, int32x4_t y)
+{
+    return vandq_s32(x, y);
+}
+
+/* a negative count makes vshlq shift right */
+static inline int32x4_t neon_getByte(int32x4_t x, int32x4_t n)
+{
+    return S(vandq_u32(vshlq_u32(U(x), vnegq_s32(vshlq_n_s32(n, 3))),
+                       vdupq_n_u32(0xff)));
+}
+
+static inline int32x4_t neon_bang(int32x4_t x)
+{
+    return S(vandq_u32(vceqq_s32(x, vdupq_n_s32(0)), vdupq_n_u32(1)));
+}
+
+static inline int32x4_t neon_negate(int32x4_t x)
+{
+    return vnegq_s32(x);
+}
+
+static inline int32x4_t neon_isPositive(int32x4_t x)
+{
+    return S(vandq_u32(vcgtq_s32(x, vdupq_n_s32(0)), vdupq_n_u32(1)));
+}
+
+static inline int32x4_t neon_float_neg(int32x4_t v)
+{
+    uint32x4_t uf = U(v), sign = vdupq_n_u32(0x80000000);
+    uint32x4_t nan = vcgtq_u32(vbicq_u32(uf, sign), vdupq_n_u32(0x7f800000));
+    return S(veorq_u32(uf, vbicq_u32(sign, nan)));
+}
+
+static inline int32x4_t neon_float_twice(int32x4_t v)
+{
+    uint32x4_t uf = U(v);
+    uint32x4_t exp = vandq_u32(uf, vdupq_n_u32(0x7f800000));
+    uint32x4_t sign = vandq_u32(uf, vdupq_n_u32(0x80000000));
+    uint32x4_t r = vaddq_u32(uf, vdupq_n_u32(0x00800000));
+    r = vbslq_u32(vceqq_u32(exp, vdupq_n_u32(0x7f000000)),
+                  vorrq_u32(sign, vdupq_n_u32(0x7f800000)), r);
+    r = vbslq_u32(vceqq_u32(exp, vdupq_n_u32(0)),
+                  vorrq_u32(sign, vshlq_n_u32(uf, 1)), r);
+    return S(vbslq_u32(vceqq_u32(exp, vdupq_n_u32(0x7f800000)), uf, r));
+}
+
+KERNEL2(neon, bitAnd, int, int32x4_t, 4, NEON_LOAD, NEON_STORE, neon_bitAnd)
+KERNEL2(neon, getByte, int, int32x4_t, 4, NEON_LOAD, NEON_STORE, neon_getByte)
+KERNEL1(neon, bang, int, int32x4_t, 4, NEON_LOAD, NEON_STORE, neon_bang)
+KERNEL1(neon, negate, int, int32x4_t, 4, NEON_LOAD, NEON_STORE, neon_negate)
+KERNEL1(neon, isPositive, int, int32x4_t, 4, NEON_LOAD, NEON_STORE, neon_isPositive)
+KERNEL1(neon, float_neg, unsigned, int32x4_t, 4, NEON_LOAD, NEON_STORE, neon_float_neg)
+KERNEL1(neon, float_twice, unsigned, int32x4_t, 4, NEON_LOAD, NEON_STORE, neon_float_twice)
+
+static const struct kernels neon_kernels = {
+    "neon", neon_supported,
+    bitAnd_neon, getByte_neon, bang_neon, negate_neon,
+    isPositive_neon, float_neg_neon, float_twice_neon
+};
+#endif /* BATCH_NEON */
+
+/*
+ * Dispatch
+ */
+
+/* Every kernel set built in, best last */
+static const struct kernels *const all_kernels[] = {
+    &scalar_kernels,
+#ifdef BATCH_X86
+    &sse2_kernels,
+    &avx2_kernels,
+#endif
+#ifdef BATCH_NEON
+    &neon_kernels,
+#endif
+};
+#define NKERNELS (sizeof(all_kernels) / sizeof(all_kernels[0]))
+
+/* The kernels in use; racing first calls all store the same pointer */
+static const struct kernels *kern;
+
+/* pick - Choose the kernels on the first call */
+static const struct kernels *pick(void)
+{
+    const char *isa = getenv("BITS_ISA");
+    int i;
+
+    if (isa != NULL && bits_batch_use(isa))
+        return kern;
+    for (i = NKERNELS - 1; !all_kernels[i]->supported(); i--)
+        ;
+    return kern = all_kernels[i];
+}
+#define K() (kern ? kern : pick())
+
+const char *bits_batch_isa(void)
+{
+    return K()->name;
+}
+
+int bits_batch_use(const char *isa)
+{
+    size_t i;
+
+    for (i = 0; i < NKERNELS; i++) {
+        if (!strcmp(all_kernels[i]->name, isa) && all_kernels[i]->supported()) {
+            kern = all_kernels[i];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void bitAnd_n(const int *x, const int *y, int *out, size_t n)
+{
+    K()->bitAnd(x, y, out, n);
+}
+
+void getByte_n(const int *x, const int *byte, int *out, size_t n)
+{
+    K()->getByte(x, byte, out, n);
+}
+
+void bang_n(const int *x, int *out, size_t n)
+{
+    K()->bang(x, out, n);
+}
+
+void negate_n(const int *x, int *out, size_t n)
+{
+    K()->negate(x, out, n);
+}
+
+void isPositive_n(const int *x, int *out, size_t n)
+{
+    K()->isPositive(x, out, n);
+}
+
+void float_neg_n(const unsigned *in, unsigned *out, size_t n)
+{
+    K()->float_neg(in, out, n);
+}
+
+void float_twice_n(const unsigned *in, unsigned *out, size_t n)
+{
+    K()->float_twice(in, out, n);
+}
@@ -0,0 +1,32 @@
+/*
+ * bits_batch.h - Array versions of the bits.c puzzles
+ *
+ * Each *_n function applies its bits.c counterpart to n elements and
+ * gives bit-exactly the same results, special cases included. in and
+ * out may be the same array. getByte_n needs every byte index in 0..3,
+ * as getByte does.
+ */
+#ifndef BITS_BATCH_H
+#define BITS_BATCH_H
+
+#include <stddef.h>
+
+void bitAnd_n(const int *x, const int *y, int *out, size_t n);
+void getByte_n(const int *x, const int *byte, int *out, size_t n);
+void bang_n(const int *x, int *out, size_t n);
+void negate_n(const int *x, int *out, size_t n);
+void isPositive_n(const int *x, int *out, size_t n);
+void float_neg_n(const unsigned *in, unsigned *out, size_t n);
+void float_twice_n(const unsigned *in, unsigned *out, size_t n);
+
+/*
+ * The instruction set the *_n functions use, picked on the first call
+ * from what the CPU supports, or from BITS_ISA in the environment:
+ * "scalar", "sse2", "avx2" (x86-64) or "neon" (AArch64)
+ */
+const char *bits_batch_isa(void);
+
+/* Use isa from now on; returns 0 if it is unknown or unsupported here */
+int bits_batch_use(const char *isa);
+
+#endif /* BITS_BATCH_H */
@@ -0,0 +1,49 @@
+/*
+ * softfloat.c - Array versions of the softfloat.h operations
+ *
+ * Each loop inlines its operation, so the compiler can keep the
+ * constants in registers and, where the operation is branch-free
+ * enough (the compares, float_f2i), vectorize the loop.
+ *
+ *     gcc -O2 -c softfloat.c
+ */
+#include "softfloat.h"
+
+void float_i2f_n(const int *in, unsigned *out, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        out[i] = float_i2f(in[i]);
+}
+
+void float_f2i_n(const unsigned *in, int *out, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        out[i] = float_f2i(in[i]);
+}
+
+void float_scale_n(const unsigned *in, int k, unsigned *out, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        out[i] = float_scale(in[i], k);
+}
+
+/* OP2 - out[i] = float_op(f[i], g[i]) */
+#define OP2(op, T)                                                      \
+void float_##op##_n(const unsigned *f, const unsigned *g, T *out, size_t n) \
+{                                                                       \
+    size_t i;                                                           \
+                                                                        \
+    for (i = 0; i < n; i++)                                             \
+        out[i] = float_##op(f[i], g[i]);                                \
+}
+OP2(add, unsigned)
+OP2(mul, unsigned)
+OP2(lt, int)
+OP2(le, int)
+OP2(eq, int)
@@ -0,0 +1,249 @@
+/*
+ * softfloat.h - Single-precision float arithmetic on the unsigned bit
+ *               pattern, for targets without an FPU
+ *
+ * The same representation the float puzzles in bits.c use: an unsigned
+ * holding the IEEE 754 binary32 bits of a float. Results are rounded to
+ * nearest, ties to even, as the FPU does by default, and denormals are
+ * handled in full. A NaN result is always the quiet NaN 0x7fc00000 (x86
+ * hardware would keep the payload, or give 0xffc00000); float_scale
+ * alone returns a NaN argument unchanged, as float_twice does.
+ *
+ * Everything is static inline so that calls with constant arguments
+ * fold at compile time and the rest inline into the caller. The
+ * softfloat.c file holds the array versions.
+ *
+ * No tables: normalising uses __builtin_clz, and the common paths branch
+ * only on the special operands (NaN, infinity, zero), on overflow and
+ * underflow in rounding, and in add to handle opposite signs.
+ */
+#ifndef SOFTFLOAT_H
+#define SOFTFLOAT_H
+
+#include <stddef.h>
+
+#define SF_SIGN   0x80000000u
+#define SF_INF    0x7f800000u
+#define SF_NAN    0x7fc00000u       /* the quiet NaN every NaN result gets */
+#define SF_FRAC   0x007fffffu
+
+/* sf_isnan - True if uf is a NaN */
+static inline int sf_isnan(unsigned uf)
+{
+    return (uf & ~SF_SIGN) > SF_INF;
+}
+
+/*
+ * sf_shift_right_jam - a >> n, with the bits shifted out ORed into bit 0
+ *     so rounding still sees them
+ */
+static inline unsigned sf_shift_right_jam(unsigned a, int n)
+{
+    if (n <= 0)
+        return a;
+    if (n >= 31)
+        return a != 0;
+    return a >> n | ((a << (32 - n)) != 0);
+}
+
+/*
+ * sf_round_pack - Round and pack sign | 2^(exp + 1 - 157) * sig, where
+ *     sig has its leading 1 in bit 30 (7 bits below the float's last
+ *     bit). exp is then one less than the biased exponent; below zero,
+ *     the result is denormal or rounds to zero, and above 0xfd it
+ *     overflows to infinity.
+ */
+static inline unsigned sf_round_pack(unsigned sign, int exp, unsigned sig)
+{
+    unsigned round;
+
+    if ((unsigned)exp >= 0xfd) {
+        if (exp < 0) {
+            sig = sf_shift_right_jam(sig, -exp);
+            exp = 0;
+        } else if (exp > 0xfd || sig + 0x40 >= 0x80000000u) {
+            return sign | SF_INF;
+        }
+    }
+    round = sig & 0x7f;
+    sig = (sig + 0x40) >> 7;
+    sig ^= sig & (round == 0x40);               /* ties to even */
+    /* + not |, so a carry out of the fraction bumps the exponent */
+    return sign + ((unsigned)(sig ? exp : 0) << 23) + sig;
+}
+
+/*
+ * sf_unpack - Split finite, nonzero uf into a significand with its
+ *     leading 1 in bit 23 and the biased exponent that goes with it
+ *     (below 1 for a denormal)
+ */
+static inline unsigned sf_unpack(unsigned uf, int *exp)
+{
+    unsigned e = (uf >> 23) & 0xff, m = uf & SF_FRAC;
+    int n;
+
+    if (e == 0) {
+        n = __builtin_clz(m) - 8;
+        *exp = 1 - n;
+        return m << n;
+    }
+    *exp = e;
+    return m | 0x00800000;
+}
+
+/*
+ * float_i2f - Return the bit pattern of (float) x
+ */
+static inline unsigned float_i2f(int x)
+{
+    unsigned sign = (unsigned)x & SF_SIGN;
+    unsigned a = sign ? 0u - (unsigned)x : (unsigned)x;
+    int n;
+
+    if (a == 0)
+        return 0;
+    n = __builtin_clz(a);
+    a <<= n;
+    return sf_round_pack(sign, 0x9d - n, a >> 1 | (a & 1));
+}
+
+/*
+ * float_f2i - Return (int) f, truncated toward zero. NaN and values out
+ *     of int range give 0x80000000, as x86's cvttss2si does.
+ */
+static inline int float_f2i(unsigned uf)
+{
+    int e = (uf >> 23) & 0xff;
+    unsigned m = (uf & SF_FRAC) | 0x00800000;
+    unsigned neg = (unsigned)((int)uf >> 31);
+
+    if (e < 127)
+        return 0;
+    if (e >= 158)
+        return (int)SF_SIGN;
+    m = e >= 150 ? m << (e - 150) : m >> (150 - e);
+    return (int)((m ^ neg) - neg);
+}
+
+/*
+ * float_scale - Return f * 2^k. NaN comes back unchanged, so
+ *     float_scale(uf, 1) is float_twice(uf).
+ */
+static inline unsigned float_scale(unsigned uf, int k)
+{
+    unsigned sign = uf & SF_SIGN, m;
+    int exp;
+
+    if ((uf & ~SF_SIGN) >= SF_INF || (uf & ~SF_SIGN) == 0)
+        return uf;
+    k = k > 300 ? 300 : k < -300 ? -300 : k;    /* past any float range */
+    m = sf_unpack(uf, &exp);
+    return sf_round_pack(sign, exp + k - 1, m << 7);
+}
+
+/*
+ * float_mul - Return the bit pattern of f * g
+ */
+static inline unsigned float_mul(unsigned uf, unsigned ug)
+{
+    unsigned sign = (uf ^ ug) & SF_SIGN;
+    unsigned af = uf & ~SF_SIGN, ag = ug & ~SF_SIGN, sig;
+    unsigned long long prod;
+    int ef, eg, exp;
+
+    if (af > SF_INF || ag > SF_INF)
+        return SF_NAN;
+    if (af == SF_INF || ag == SF_INF)
+        return af == 0 || ag == 0 ? SF_NAN : sign | SF_INF;
+    if (af == 0 || ag == 0)
+        return sign;
+
+    prod = (unsigned long long)(sf_unpack(uf, &ef) << 7) * (sf_unpack(ug, &eg) << 8);
+    sig = (unsigned)(prod >> 32) | ((unsigned)prod != 0);
+    /* product of two [1,2) significands: leading 1 in bit 29 or 30 */
+    exp = ef + eg - 0x7f - (sig < 0x40000000);
+    return sf_round_pack(sign, exp, sig << (sig < 0x40000000));
+}
+
+/*
+ * float_add - Return the bit pattern of f + g
+ */
+static inline unsigned float_add(unsigned uf, unsigned ug)
+{
+    unsigned swap, mf, mg, m, sign;
+    int ef, eg, n;
+
+    if (sf_isnan(uf) || sf_isnan(ug))
+        return SF_NAN;
+
+    /* put the larger magnitude in uf */
+    swap = (uf & ~SF_SIGN) < (ug & ~SF_SIGN) ? uf ^ ug : 0;
+    uf ^= swap;
+    ug ^= swap;
+    sign = uf & SF_SIGN;
+
+    if ((uf & ~SF_SIGN) == SF_INF)
+        return ug == (uf ^ SF_SIGN) ? SF_NAN : uf;
+    if ((ug & ~SF_SIGN) == 0)
+        return (uf & ~SF_SIGN) ? uf : uf & ug;  /* -0 only from -0 + -0 */
+
+    /* fixed point with 7 guard bits, both on uf's exponent */
+    mf = sf_unpack(uf, &ef) << 7;
+    mg = sf_unpack(ug, &eg) << 7;
+    mg = sf_shift_right_jam(mg, ef - eg);
+    if ((uf ^ ug) & SF_SIGN) {
+        m = mf - mg;
+        if (m == 0)
+            return 0;
+    } else {
+        m = mf + mg;
+    }
+
+    /* back to the leading 1 in bit 30 */
+    n = __builtin_clz(m) - 1;
+    if (n < 0)
+        return sf_round_pack(sign, ef, m >> 1 | (m & 1));
+    return sf_round_pack(sign, ef - 1 - n, m << n);
+}
+
+/*
+ * sf_key - Map the bit pattern of a non-NaN to an int ordered as the
+ *     floats are, with +0 and -0 both 0
+ */
+static inline int sf_key(unsigned uf)
+{
+    int neg = (int)uf >> 31;
+
+    return ((int)(uf & ~SF_SIGN) ^ neg) - neg;
+}
+
+/* float_lt, float_le, float_eq - f < g, f <= g, f == g (false on NaN) */
+static inline int float_lt(unsigned uf, unsigned ug)
+{
+    return !sf_isnan(uf) & !sf_isnan(ug) & (sf_key(uf) < sf_key(ug));
+}
+
+static inline int float_le(unsigned uf, unsigned ug)
+{
+    return !sf_isnan(uf) & !sf_isnan(ug) & (sf_key(uf) <= sf_key(ug));
+}
+
+static inline int float_eq(unsigned uf, unsigned ug)
+{
+    return !sf_isnan(uf) & !sf_isnan(ug) & (sf_key(uf) == sf_key(ug));
+}
+
+/*
+ * Array versions, in softfloat.c: out[i] = op(in[i]) or op(f[i], g[i]).
+ * out may be the same array as an input.
+ */
+void float_i2f_n(const int *in, unsigned *out, size_t n);
+void float_f2i_n(const unsigned *in, int *out, size_t n);
+void float_scale_n(const unsigned *in, int k, unsigned *out, size_t n);
+void float_add_n(const unsigned *f, const unsigned *g, unsigned *out, size_t n);
+void float_mul_n(const unsigned *f, const unsigned *g, unsigned *out, size_t n);
+void float_lt_n(const unsigned *f, const unsigned *g, int *out, size_t n);
+void float_le_n(const unsigned *f, const unsigned *g, int *out, size_t n);
+void float_eq_n(const unsigned *f, const unsigned *g, int *out, size_t n);
+
+#endif /* SOFTFLOAT_H */
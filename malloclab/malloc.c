@@ -10,7 +10,9 @@
  *      ----------------------------------- 
  * 
  * where s are the meaningful size bits and a/f is set 
- * iff the block is allocated. The list has the following form:
+ * iff the block is allocated. With FOOTERLESS, bit 1 of the header
+ * is set iff the previous block is allocated, and only free blocks
+ * have a footer. The list has the following form:
  *
  * begin                                                          end
  * heap                                                           heap  
@@ -27,6 +29,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include "mm.h"
 #include "memlib.h"
 
@@ -35,6 +38,30 @@
  */
 #define NEXT_FITx
 
+/*
+ * If QUICK_LIST defined cache freed small blocks in per-size LIFO bins
+ * and only coalesce them when a bin overflows
+ */
+#define QUICK_LISTx
+
+/*
+ * If FOOTERLESS defined only free blocks carry a footer, and each header
+ * records whether the previous block is allocated
+ */
+#define FOOTERLESSx
+
+/*
+ * If REALLOC_HEADROOM defined a growing realloc reserves half as much
+ * again, so repeated small growths stay in place
+ */
+#define REALLOC_HEADROOMx
+
+/*
+ * If WORD64 defined headers and footers are 8-byte words and payloads
+ * are 16-byte aligned, else 4-byte words and 8-byte alignment
+ */
+#define WORD64x
+
 /* Team structure (this should be one-man team, meaning that you are the only member of the team) */
 team_t team = {
 #ifdef NEXT_FIT
@@ -48,47 +75,116 @@ team_t team = {
 
 /* $begin mallocmacros */
 /* Basic constants and macros */
+#ifdef WORD64
+#define WSIZE       8       /* word size (bytes) */
+typedef uint64_t word_t;    /* header/footer word */
+#else
 #define WSIZE       4       /* word size (bytes) */  
-#define DSIZE       8       /* doubleword size (bytes) */
+typedef uint32_t word_t;    /* header/footer word */
+#endif
+#define DSIZE      (2*WSIZE) /* doubleword size, payload alignment (bytes) */
+#define PSIZE       8       /* pointer size (bytes) */
 #define CHUNKSIZE  (1<<12)  /* initial heap size (bytes) */
-#define OVERHEAD    8       /* overhead of header and footer (bytes) */
+#define OVERHEAD   (2*WSIZE) /* overhead of header and footer (bytes) */
+#define MINBLOCK   (DSIZE + OVERHEAD) /* smallest splittable block (bytes) */
+#define QL_BINS     16      /* number of quick list bins, DSIZE apart */
+#define QL_LIMIT    32      /* blocks cached per bin before a flush */
+#define QL_MINBLOCK MINBLOCK /* block size held by bin 0 (bytes) */
 
 #define MAX(x, y) ((x) > (y)? (x) : (y))
 #define MIN(x, y) ((x) > (y) ? (y) : (x))
 
+#ifdef FOOTERLESS
+#define PREVALLOC   0x2     /* header bit: previous block is allocated */
+#else
+#define PREVALLOC   0
+#endif
+
+/* Adjusted block size for a request of size payload bytes */
+#ifdef FOOTERLESS
+#define ASIZE(size)  MAX(MINBLOCK, DSIZE * (((size) + WSIZE + (DSIZE - 1)) / DSIZE))
+#else
+#define ASIZE(size)  (DSIZE * (((size) + OVERHEAD + (DSIZE - 1)) / DSIZE))
+#endif
+
+/* Payload bytes a growing realloc reserves for a request of size bytes */
+#ifdef REALLOC_HEADROOM
+#define HEADROOM(size)  ((size) + (size) / 2)
+#else
+#define HEADROOM(size)  (size)
+#endif
+
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc)  ((size) | (alloc))
 
 /* Read and write a word at address p */
-#define GET(p)       (*(size_t *)(p))
-#define PUT(p, val)  (*(size_t *)(p) = (val))  
+#define GET(p)       (*(word_t *)(p))
+#define PUT(p, val)  (*(word_t *)(p) = (val))  
+#define PUT_ADDR(p, val) (*(void **)(p) = (void *) (val))
 
 /* Read the size and allocated fields from address p */
-#define GET_SIZE(p)  (GET(p) & ~0x7)
+#define GET_SIZE(p)  ((size_t)(GET(p) & ~0x7))
 #define GET_ALLOC(p) (GET(p) & 0x1)
 
+/* Read the previous-allocated field from header address p */
+#define GET_PREV_ALLOC(p) (GET(p) & PREVALLOC)
+
 /* Given block ptr bp, compute address of its header and footer */
 #define HDRP(bp)       ((char *)(bp) - WSIZE)  
 #define FTRP(bp)       ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
 
+/* Given block ptr bp, compute its usable payload size */
+#ifdef FOOTERLESS
+#define PAYLOAD_SIZE(bp)  (GET_SIZE(HDRP(bp)) - WSIZE)
+#else
+#define PAYLOAD_SIZE(bp)  (GET_SIZE(HDRP(bp)) - OVERHEAD)
+#endif
+
 /* Given block ptr bp, compute address of next and previous blocks */
 #define NEXT_BLKP(bp)  ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
 #define PREV_BLKP(bp)  ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
+
+/* Given block ptr bp, read whether the previous block is allocated */
+#ifdef FOOTERLESS
+#define PREV_ALLOCATED(bp)  GET_PREV_ALLOC(HDRP(bp))
+#else
+#define PREV_ALLOCATED(bp)  GET_ALLOC(FTRP(PREV_BLKP(bp)))
+#endif
+
+/* Given quick list block ptr bp, compute the next cached block */
+#define NEXT_BLKP_QL(bp)  (*(void **)(bp))
+
+/* Given quick list bin i, compute address of its head pointer and block count */
+#define QL_HEAD(i)     (ql_listp + (i) * 2 * PSIZE)
+#define QL_COUNT(i)    (ql_listp + (i) * 2 * PSIZE + PSIZE)
 /* $end mallocmacros */
 
 /* Global variables */
 static char *heap_listp;  /* pointer to first block */  
+#ifdef QUICK_LIST
+static char *ql_listp;    /* pointer to first quick list bin */
+#endif
 #ifdef NEXT_FIT
 static char *rover;       /* next fit rover */
 #endif
 
 /* function prototypes for internal helper routines */
 static void *extend_heap(size_t words);
+static int align_heap(void);
 static void place(void *bp, size_t asize);
+static void realloc_place(void *bp, size_t total, size_t target);
 static void *find_fit(size_t asize);
 static void *coalesce(void *bp);
 static void printblock(void *bp); 
 static void checkblock(void *bp);
+static void setblock(void *bp, size_t size, int alloc);
+#ifdef QUICK_LIST
+static int ql_bin(size_t size);
+static void *ql_pop(size_t asize);
+static int ql_push(void *bp);
+static void ql_flush(int i);
+static int ql_flushall(void);
+#endif
 
 /* 
  * mm_init - Initialize the memory manager 
@@ -96,13 +192,30 @@ static void checkblock(void *bp);
 /* $begin mminit */
 int mm_init(void) 
 {
+#ifdef QUICK_LIST
+    int i;
+#endif
+
+    if (align_heap() < 0)
+	return -1;
+
+#ifdef QUICK_LIST
+    /* The quick list bins live in front of the heap, like the prologue */
+    if ((ql_listp = mem_sbrk(QL_BINS * 2 * PSIZE)) == (void *)-1)
+	return -1;
+    for (i = 0; i < QL_BINS; i++) {
+	PUT_ADDR(QL_HEAD(i), NULL);
+	PUT(QL_COUNT(i), 0);
+    }
+#endif
+
     /* create the initial empty heap */
     if ((heap_listp = mem_sbrk(4*WSIZE)) == (void *)-1)
 	return -1;
     PUT(heap_listp, 0);                        /* alignment padding */
-    PUT(heap_listp+WSIZE, PACK(OVERHEAD, 1));  /* prologue header */ 
+    PUT(heap_listp+WSIZE, PACK(OVERHEAD, 1) | PREVALLOC); /* prologue header */
     PUT(heap_listp+DSIZE, PACK(OVERHEAD, 1));  /* prologue footer */ 
-    PUT(heap_listp+WSIZE+DSIZE, PACK(0, 1));   /* epilogue header */
+    PUT(heap_listp+WSIZE+DSIZE, PACK(0, 1) | PREVALLOC); /* epilogue header */
     heap_listp += DSIZE;
 
 #ifdef NEXT_FIT
@@ -125,12 +238,24 @@ void *mm_malloc(size_t size)
 	if (size == 0) {
         return NULL;
     }
-    size_t realSize = DSIZE * ((size + OVERHEAD + (DSIZE - 1)) / DSIZE);
-    void *bp = find_fit(realSize);
+    size_t realSize = ASIZE(size);
+    void *bp;
+#ifdef QUICK_LIST
+    if ((bp = ql_pop(realSize)) != NULL)
+        return bp;
+#endif
+    bp = find_fit(realSize);
     if (bp != NULL) {
         place(bp, realSize);
         return bp;
     }
+#ifdef QUICK_LIST
+    /* cached blocks may hide a fit, so flush them before growing the heap */
+    if (ql_flushall() && (bp = find_fit(realSize)) != NULL) {
+        place(bp, realSize);
+        return bp;
+    }
+#endif
     bp = extend_heap(MAX(CHUNKSIZE, realSize) / WSIZE);
     if (bp == NULL) return NULL;
     place(bp, realSize);
@@ -145,60 +270,77 @@ void *mm_malloc(size_t size)
 void mm_free(void *bp)
 {
     if (!GET_ALLOC(HDRP(bp))) return;
+#ifdef QUICK_LIST
+    if (ql_push(bp)) return;
+#endif
 	char *ptr = (char*) bp;
-    PUT(HDRP(ptr), GET_SIZE(HDRP(ptr)));
-    PUT(FTRP(ptr), GET_SIZE(HDRP(ptr)));
+    setblock(ptr, GET_SIZE(HDRP(ptr)), 0);
     coalesce(ptr);
 }
 
 /* $end mmfree */
 
 /*
- * mm_realloc - naive implementation of mm_realloc
+ * mm_realloc - Resize a block in place whenever its neighbours allow it:
+ *     grow into a free next block, extend the heap when the block is
+ *     last, or slide back into a free previous block. Only copy to a new
+ *     block when none of these fit.
  */
 void *mm_realloc(void *ptr, size_t size)
 {
-    size_t realSize = DSIZE * ((size + OVERHEAD + (DSIZE - 1)) / DSIZE);
+    size_t asize, target, oldsize, total;
+    void *nxt, *prv, *bp;
+
     if (ptr == NULL) {
-        return mm_malloc(realSize);
+        return mm_malloc(size);
     } else if (size == 0) {
-        free(ptr);
+        mm_free(ptr);
         return NULL;
     }
-    size_t remainSize = GET_SIZE(HDRP(ptr)) - realSize;
+    asize = ASIZE(size);
+    target = ASIZE(HEADROOM(size));
+    oldsize = GET_SIZE(HDRP(ptr));
+
     //allocate within existing block
-    if (GET_SIZE(HDRP(ptr)) >= realSize) {
-        if (remainSize >= (DSIZE + OVERHEAD)) {
-            PUT(HDRP(ptr), PACK(realSize, 1));
-            PUT(FTRP(ptr), PACK(realSize, 1));
-            void *nxt = NEXT_BLKP(ptr);
-            PUT(HDRP(nxt), PACK(remainSize, 0));
-            PUT(FTRP(nxt), PACK(remainSize, 0));
-        } 
+    if (oldsize >= asize) {
+        realloc_place(ptr, oldsize, target);
         return ptr;
     }
-    //extend block
-    void *nxt = NEXT_BLKP(ptr);
-    if (!GET_ALLOC(HDRP(nxt)) && (GET_SIZE(HDRP(nxt)) >= remainSize)) {
-        size_t totalSize = GET_SIZE(HDRP(ptr)) + GET_SIZE(HDRP(nxt));
-        if ((totalSize - realSize) >= (DSIZE + OVERHEAD)) {
-            PUT(HDRP(ptr), PACK(realSize, 1));
-            PUT(FTRP(ptr), PACK(realSize, 1));
-            nxt = NEXT_BLKP(ptr);
-            PUT(HDRP(nxt), PACK(totalSize - realSize, 0));
-            PUT(FTRP(nxt), PACK(totalSize - realSize, 0));
-        } else {
-            PUT(HDRP(ptr), PACK(totalSize, 1));
-            PUT(FTRP(ptr), PACK(totalSize, 1));
-        }
+
+    nxt = NEXT_BLKP(ptr);
+    total = oldsize;
+    if (!GET_ALLOC(HDRP(nxt)))
+        total += GET_SIZE(HDRP(nxt));
+
+    //last block in the heap: sbrk just the missing bytes
+    if (total < target &&
+        GET_SIZE(HDRP(GET_ALLOC(HDRP(nxt)) ? nxt : NEXT_BLKP(nxt))) == 0 &&
+        extend_heap((target - total) / WSIZE) != NULL) {
+        nxt = NEXT_BLKP(ptr);
+        total = oldsize + GET_SIZE(HDRP(nxt));
+    }
+
+    //extend block into the next free block
+    if (!GET_ALLOC(HDRP(nxt)) && total >= asize) {
+        realloc_place(ptr, total, target);
         return ptr;
-    } 
-    
+    }
+
+    //slide block back over a free previous block
+    if (!PREV_ALLOCATED(ptr)) {
+        prv = PREV_BLKP(ptr);
+        total += GET_SIZE(HDRP(prv));
+        if (total >= asize) {
+            memmove(prv, ptr, PAYLOAD_SIZE(ptr));
+            realloc_place(prv, total, target);
+            return prv;
+        }
+    }
+
     //move block
-    void *bp = mm_malloc(realSize);
+    bp = mm_malloc(HEADROOM(size));
     if (bp == NULL) return NULL;
-    size_t copySize = MIN(size, GET_SIZE(HDRP(ptr)));
-    memcpy(bp, ptr, copySize);
+    memcpy(bp, ptr, MIN(size, PAYLOAD_SIZE(ptr)));
     mm_free(ptr);
     return bp;
 }
@@ -222,12 +364,32 @@ void mm_checkheap(int verbose)
 	if (verbose) 
 	    printblock(bp);
 	checkblock(bp);
+#ifdef FOOTERLESS
+	if (!GET_ALLOC(HDRP(bp)) != !GET_PREV_ALLOC(HDRP(NEXT_BLKP(bp))))
+	    printf("Error: %p previous-allocated bit is stale\n", NEXT_BLKP(bp));
+#endif
     }
      
     if (verbose)
 	printblock(bp);
     if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp))))
 	printf("Bad epilogue header\n");
+
+#ifdef QUICK_LIST
+    /* cached blocks must still look allocated and sit in their own bin */
+    for (int i = 0; i < QL_BINS; i++) {
+	size_t count = 0;
+	for (bp = NEXT_BLKP_QL(QL_HEAD(i)); bp != NULL; bp = NEXT_BLKP_QL(bp)) {
+	    if (!GET_ALLOC(HDRP(bp)))
+		printf("Error: %p in quick list %d is not allocated\n", bp, i);
+	    if (ql_bin(GET_SIZE(HDRP(bp))) != i)
+		printf("Error: %p in quick list %d has the wrong size\n", bp, i);
+	    count++;
+	}
+	if (count != GET(QL_COUNT(i)))
+	    printf("Error: quick list %d count does not match\n", i);
+    }
+#endif
 }
 
 /* The remaining routines are internal helper routines */
@@ -247,8 +409,7 @@ static void *extend_heap(size_t words)
 	return NULL;
 
     /* Initialize free block header/footer and the epilogue header */
-    PUT(HDRP(bp), PACK(size, 0));         /* free block header */
-    PUT(FTRP(bp), PACK(size, 0));         /* free block footer */
+    setblock(bp, size, 0);                /* free block header/footer */
     PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* new epilogue header */
 
     /* Coalesce if the previous block was free */
@@ -256,6 +417,18 @@ static void *extend_heap(size_t words)
 }
 /* $end mmextendheap */
 
+/* 
+ * align_heap - Pad the break so the first payload is DSIZE aligned
+ */
+static int align_heap(void)
+{
+    size_t brk = (size_t)mem_heap_hi() + 1;
+
+    if ((brk % DSIZE) && mem_sbrk(DSIZE - brk % DSIZE) == (void *)-1)
+	return -1;
+    return 0;
+}
+
 /* 
  * place - Place block of asize bytes at start of free block bp 
  *         and split if remainder would be at least minimum block size
@@ -267,20 +440,38 @@ static void place(void *bp, size_t asize)
 {
     size_t csize = GET_SIZE(HDRP(bp));   
 
-    if ((csize - asize) >= (DSIZE + OVERHEAD)) { 
-	PUT(HDRP(bp), PACK(asize, 1));
-	PUT(FTRP(bp), PACK(asize, 1));
+    if ((csize - asize) >= MINBLOCK) { 
+	setblock(bp, asize, 1);
 	bp = NEXT_BLKP(bp);
-	PUT(HDRP(bp), PACK(csize-asize, 0));
-	PUT(FTRP(bp), PACK(csize-asize, 0));
+	setblock(bp, csize-asize, 0);
     }
     else { 
-	PUT(HDRP(bp), PACK(csize, 1));
-	PUT(FTRP(bp), PACK(csize, 1));
+	setblock(bp, csize, 1);
     }
 }
 /* $end mmplace */
 
+/* 
+ * realloc_place - Make bp an allocated block spanning total bytes and
+ *     give back whatever lies beyond target bytes as a free block
+ */
+static void realloc_place(void *bp, size_t total, size_t target)
+{
+    if (target + MINBLOCK <= total) {
+	setblock(bp, target, 1);
+	setblock(NEXT_BLKP(bp), total - target, 0);
+	coalesce(NEXT_BLKP(bp));
+    }
+    else {
+	setblock(bp, total, 1);
+    }
+#ifdef NEXT_FIT
+    /* Make sure the rover isn't pointing into the block we just grew */
+    if ((rover > (char *)bp) && (rover < NEXT_BLKP(bp)))
+	rover = bp;
+#endif
+}
+
 /* 
  * find_fit - Find a fit for a block with asize bytes 
  */
@@ -319,7 +510,7 @@ static void *find_fit(size_t asize)
  */
 static void *coalesce(void *bp) 
 {
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
+    size_t prev_alloc = PREV_ALLOCATED(bp);
     size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
     size_t size = GET_SIZE(HDRP(bp));
 
@@ -329,23 +520,20 @@ static void *coalesce(void *bp)
 
     else if (prev_alloc && !next_alloc) {      /* Case 2 */
 	size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
-	PUT(HDRP(bp), PACK(size, 0));
-	PUT(FTRP(bp), PACK(size,0));
+	setblock(bp, size, 0);
     }
 
     else if (!prev_alloc && next_alloc) {      /* Case 3 */
 	size += GET_SIZE(HDRP(PREV_BLKP(bp)));
-	PUT(FTRP(bp), PACK(size, 0));
-	PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
 	bp = PREV_BLKP(bp);
+	setblock(bp, size, 0);
     }
 
     else {                                     /* Case 4 */
 	size += GET_SIZE(HDRP(PREV_BLKP(bp))) + 
 	    GET_SIZE(FTRP(NEXT_BLKP(bp)));
-	PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-	PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
 	bp = PREV_BLKP(bp);
+	setblock(bp, size, 0);
     }
 
 #ifdef NEXT_FIT
@@ -368,21 +556,139 @@ static void printblock(void *bp)
     fsize = GET_SIZE(FTRP(bp));
     falloc = GET_ALLOC(FTRP(bp));  
     
+#ifdef FOOTERLESS
+    if (hsize != 0 && halloc) {
+	printf("%p: header: [%lu:%c:%c]\n", bp, (unsigned long)hsize,
+	       'a', (GET_PREV_ALLOC(HDRP(bp)) ? 'a' : 'f'));
+	return;
+    }
+#endif
+
     if (hsize == 0) {
 	printf("%p: EOL\n", bp);
 	return;
     }
 
-    printf("%p: header: [%d:%c] footer: [%d:%c]\n", bp, 
-	   hsize, (halloc ? 'a' : 'f'), 
-	   fsize, (falloc ? 'a' : 'f')); 
+    printf("%p: header: [%lu:%c] footer: [%lu:%c]\n", bp, 
+	   (unsigned long)hsize, (halloc ? 'a' : 'f'), 
+	   (unsigned long)fsize, (falloc ? 'a' : 'f')); 
 }
 
 static void checkblock(void *bp) 
 {
-    if ((size_t)bp % 8)
+    if ((size_t)bp % DSIZE)
 	printf("Error: %p is not doubleword aligned\n", bp);
+#ifdef FOOTERLESS
+    /* allocated blocks have no footer to compare against */
+    if (GET_ALLOC(HDRP(bp)))
+	return;
+    if ((GET(HDRP(bp)) & ~PREVALLOC) != GET(FTRP(bp)))
+	printf("Error: header does not match footer\n");
+#else
     if (GET(HDRP(bp)) != GET(FTRP(bp)))
 	printf("Error: header does not match footer\n");
+#endif
+}
+
+/*
+ * setblock - Write the boundary tags of block bp. With FOOTERLESS only
+ *     free blocks get a footer, bp keeps its own previous-allocated bit
+ *     and the next block's bit is updated to match alloc.
+ */
+static void setblock(void *bp, size_t size, int alloc)
+{
+#ifdef FOOTERLESS
+    char *next;
+
+    PUT(HDRP(bp), PACK(size, alloc) | GET_PREV_ALLOC(HDRP(bp)));
+    if (!alloc)
+	PUT(FTRP(bp), PACK(size, alloc));
+    next = NEXT_BLKP(bp);
+    if (alloc)
+	PUT(HDRP(next), GET(HDRP(next)) | PREVALLOC);
+    else
+	PUT(HDRP(next), GET(HDRP(next)) & ~PREVALLOC);
+#else
+    PUT(HDRP(bp), PACK(size, alloc));
+    PUT(FTRP(bp), PACK(size, alloc));
+#endif
 }
 
+#ifdef QUICK_LIST
+/*
+ * ql_bin - Return the quick list bin that caches blocks of exactly size
+ *     bytes, or -1 if blocks of that size are not cached
+ */
+static int ql_bin(size_t size)
+{
+    if (size < QL_MINBLOCK || size >= QL_MINBLOCK + QL_BINS * DSIZE)
+	return -1;
+    return (size - QL_MINBLOCK) / DSIZE;
+}
+
+/*
+ * ql_pop - Take a cached block of asize bytes, or NULL if its bin is empty.
+ *     The block is still marked allocated, so nothing else is rewritten.
+ */
+static void *ql_pop(size_t asize)
+{
+    int i = ql_bin(asize);
+    void *bp;
+
+    if (i < 0 || (bp = NEXT_BLKP_QL(QL_HEAD(i))) == NULL)
+	return NULL;
+    PUT_ADDR(QL_HEAD(i), NEXT_BLKP_QL(bp));
+    PUT(QL_COUNT(i), GET(QL_COUNT(i)) - 1);
+    return bp;
+}
+
+/*
+ * ql_push - Cache an allocated block in its bin instead of freeing it.
+ *     A full bin is flushed first. Return 0 if the block is not cacheable.
+ */
+static int ql_push(void *bp)
+{
+    int i = ql_bin(GET_SIZE(HDRP(bp)));
+
+    if (i < 0)
+	return 0;
+    if (GET(QL_COUNT(i)) >= QL_LIMIT)
+	ql_flush(i);
+    PUT_ADDR(bp, NEXT_BLKP_QL(QL_HEAD(i)));
+    PUT_ADDR(QL_HEAD(i), bp);
+    PUT(QL_COUNT(i), GET(QL_COUNT(i)) + 1);
+    return 1;
+}
+
+/*
+ * ql_flush - Really free every block cached in bin i
+ */
+static void ql_flush(int i)
+{
+    char *bp = NEXT_BLKP_QL(QL_HEAD(i));
+    char *next;
+
+    PUT_ADDR(QL_HEAD(i), NULL);
+    PUT(QL_COUNT(i), 0);
+    for (; bp != NULL; bp = next) {
+	next = NEXT_BLKP_QL(bp);
+	setblock(bp, GET_SIZE(HDRP(bp)), 0);
+	coalesce(bp);
+    }
+}
+
+/*
+ * ql_flushall - Flush every bin, return the number of blocks freed
+ */
+static int ql_flushall(void)
+{
+    int i, flushed = 0;
+
+    for (i = 0; i < QL_BINS; i++) {
+	flushed += GET(QL_COUNT(i));
+	if (GET(QL_COUNT(i)) > 0)
+	    ql_flush(i);
+    }
+    return flushed;
+}
+#endif
@@ -10,7 +10,9 @@
  *      ----------------------------------- 
  * 
  * where s are the meaningful size bits and a/f is set 
- * iff the block is allocated. The list has the following form:
+ * iff the block is allocated. With FOOTERLESS, bit 1 of the header
+ * is set iff the previous block is allocated, and only free blocks
+ * have a footer. The list has the following form:
  *
  * begin                                                          end
  * heap                                                           heap  
@@ -21,24 +23,162 @@
  *          |         block       |                       | block    |
  *
  * The allocated prologue and epilogue blocks are overhead that
- * eliminate edge conditions during coalescing.
+ * eliminate edge conditions during coalescing. With THREAD_ARENAS every
+ * arena owns one or more chunks laid out like this, and bits 56 and up
+ * of each header name the arena that owns the block. With MMAP_LARGE
+ * large blocks live in mappings of their own, outside the heap, and
+ * their header has size 0 like the epilogue's.
  */
+#define _GNU_SOURCE /* mremap, for MMAP_LARGE */
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
 #include "mm.h"
 #include "memlib.h"
+#include "mm_alloc.h"
 
 /*
  * If NEXT_FIT defined use next fit search, else use first fit search 
  */
 #define NEXT_FITx
 
+/*
+ * If SEG_FIT defined keep one explicit list per size class,
+ * else keep every free block on a single explicit list
+ */
+#define SEG_FITx
+
+/*
+ * If QUICK_LIST defined cache freed small blocks in per-size LIFO bins
+ * and only coalesce them when a bin overflows
+ */
+#define QUICK_LISTx
+
+/*
+ * If TREE_FIT defined keep large free blocks in a size-ordered treap
+ * and place them by best fit, else keep them on the free lists
+ */
+#define TREE_FITx
+
+/*
+ * If FOOTERLESS defined only free blocks carry a footer, and each header
+ * records whether the previous block is allocated
+ */
+#define FOOTERLESSx
+
+/*
+ * If DEFER_COALESCE defined freed blocks wait uncoalesced on a pending
+ * list and are coalesced in one pass, else mm_free coalesces at once
+ */
+#define DEFER_COALESCEx
+
+/*
+ * If REALLOC_HEADROOM defined a growing realloc reserves half as much
+ * again, so repeated small growths stay in place
+ */
+#define REALLOC_HEADROOMx
+
+/*
+ * If WORD64 defined headers and footers are 8-byte words and payloads
+ * are 16-byte aligned, else 4-byte words and 8-byte alignment
+ */
+#define WORD64x
+
+/*
+ * If THREAD_ARENAS defined each thread allocates from one of NARENAS
+ * arenas under the arena's own lock, and mm_free hands a block back to
+ * the arena named by the tag in its header
+ */
+#define THREAD_ARENASx
+
+/*
+ * If REMOTE_FREE defined a thread freeing another arena's block pushes it
+ * on that arena's lock-free stack instead of taking the arena's lock, and
+ * the arena frees the whole stack on its next malloc
+ */
+#define REMOTE_FREEx
+
+/*
+ * If SLAB defined requests of up to SLAB_MAXOBJ bytes come from page
+ * sized runs of equal objects that carry no header of their own
+ */
+#define SLABx
+
+/*
+ * If ADDR_ORDER defined the free list is kept in address order, with a
+ * per-region index so an insert does not walk the whole list
+ */
+#define ADDR_ORDERx
+
+/*
+ * If STATS defined keep the counters mm_stats reports, else compile
+ * every counter out
+ */
+#define STATSx
+
+/*
+ * If RECORD defined and MM_TRACE names a file, every mm_malloc, mm_free
+ * and mm_realloc call is logged to that file in the mm_record.h format
+ */
+#define RECORDx
+
+/*
+ * If MMAP_LARGE defined requests of MMAP_THRESHOLD bytes and up get a
+ * mapping of their own that mm_free unmaps, instead of a heap block
+ */
+#define MMAP_LARGEx
+
+/*
+ * If CHECK_SAMPLE defined and MM_CHECK_BUDGET is set, each mm_checkheap
+ * call checks that many blocks of every arena, picking up where the
+ * previous call stopped, instead of the whole heap
+ */
+#define CHECK_SAMPLEx
+
+/*
+ * If HUGE_PAGES defined every heap extension ends on a HUGE_PAGE boundary
+ * and the whole huge pages it covers are advised MADV_HUGEPAGE before
+ * first use; MM_PREFAULT=1 also touches the initial heap in mm_init
+ */
+#define HUGE_PAGESx
+
+#if defined(SEG_FIT) && defined(NEXT_FIT)
+#error "NEXT_FIT rover only walks a single explicit list"
+#endif
+#if defined(THREAD_ARENAS) && !defined(WORD64)
+#error "THREAD_ARENAS keeps the arena tag in the high bits of a WORD64 header"
+#endif
+#if defined(ADDR_ORDER) && defined(SEG_FIT)
+#error "ADDR_ORDER indexes the single explicit list"
+#endif
+#if defined(REMOTE_FREE) && !defined(THREAD_ARENAS)
+#error "REMOTE_FREE hands blocks between THREAD_ARENAS arenas"
+#endif
+
+#ifdef THREAD_ARENAS
+#include <pthread.h>
+#endif
+#ifdef STATS
+#include "mm_stats.h"
+#endif
+#ifdef RECORD
+#include <fcntl.h>
+#include <time.h>
+#include "mm_record.h"
+#endif
+#if defined(RECORD) || defined(MMAP_LARGE) || defined(HUGE_PAGES)
+#include <sys/mman.h>
+#endif
+
 /* Team structure (this should be one-man team, meaning that you are the only member of the team) */
 team_t team = {
 #ifdef NEXT_FIT
     "explicit next fit", 
+#elif defined(SEG_FIT)
+    "explicit segregated fit", 
 #else
     "explicit first fit", 
 #endif
@@ -48,27 +188,133 @@ team_t team = {
 
 /* $begin mallocmacros */
 /* Basic constants and macros */
+#ifdef WORD64
+#define WSIZE       8       /* word size (bytes) */
+typedef uint64_t word_t;    /* header/footer word */
+#else
 #define WSIZE       4       /* word size (bytes) */  
-#define DSIZE       8       /* doubleword size (bytes) */
+typedef uint32_t word_t;    /* header/footer word */
+#endif
+#define DSIZE      (2*WSIZE) /* doubleword size, payload alignment (bytes) */
 #define PSIZE       8       /* pointer size (bytes) */
-#define CHUNKSIZE  (1<<12)  /* initial heap size (bytes) */
-#define OVERHEAD    8       /* overhead of header and footer (bytes) */
+#define CHUNKSIZE  (1<<12)  /* initial heap size, smallest extension (bytes) */
+#define MAXCHUNK   (1<<20)  /* largest geometric heap extension (bytes) */
+#define GROW_WINDOW 256     /* extensions fewer mallocs apart double the chunk */
+#define TRIM_THRESHOLD 0    /* trailing free bytes given back to sbrk, 0 = never */
+#define OVERHEAD   (2*WSIZE) /* overhead of header and footer (bytes) */
+#define MINBLOCK   (DSIZE * ((OVERHEAD + 2*PSIZE + (DSIZE - 1)) / DSIZE)) /* smallest free block (bytes) */
+#define SEG_CLASSES 20      /* number of power-of-two size classes */
+#define QL_BINS     16      /* number of quick list bins, DSIZE apart */
+#define QL_LIMIT    32      /* blocks cached per bin before a flush */
+#define QL_MINBLOCK MINBLOCK /* block size held by bin 0 (bytes) */
+#define TREE_MINSIZE (1<<12) /* smallest block size kept in the treap (bytes) */
+#define DEFER_MAX   32      /* pending blocks before a coalescing pass */
+#define SLAB_RUN    (1<<12) /* block size of a slab run, runs are aligned to this */
+#define SLAB_BYTES  (SLAB_RUN - OVERHEAD) /* payload bytes of a slab run */
+#define SLAB_MINOBJ 32      /* object size of slab class 0 (bytes) */
+#define SLAB_CLASSES 2      /* slab class i holds SLAB_MINOBJ << i byte objects */
+#define SLAB_MAXOBJ (SLAB_MINOBJ << (SLAB_CLASSES - 1)) /* largest slab object (bytes) */
+#define SLAB_HEAP_MAX (1<<28) /* heap bytes the slab page map covers */
+#define SLAB_PAGES  (SLAB_HEAP_MAX / SLAB_RUN) /* bits in the slab page map */
+#define ADDR_REGION_SHIFT 16 /* log2 bytes per index region to start with */
+#define ADDR_REGIONS 1024   /* index regions, widened as the heap grows */
+#define LBITS       (8 * (int)sizeof(unsigned long)) /* bits per bitmap word */
+#define REC_GROW    64      /* log blocks the MM_TRACE file grows by at a time */
+#define MMAP_THRESHOLD (1<<18) /* smallest request given its own mapping (bytes) */
+#define MAP_PAGE    (1<<12) /* mappings are a multiple of this (bytes) */
+#define HUGE_PAGE   (1<<21) /* transparent huge page size (bytes) */
+#ifdef THREAD_ARENAS
+#define NARENAS     8       /* number of arenas threads are spread over */
+#define TAG_SHIFT   56      /* header bits 56 and up name the owning arena */
+#else
+#define NARENAS     1
+#endif
 
 #define MAX(x, y) ((x) > (y)? (x) : (y))
 #define MIN(x, y) ((x) > (y)? (y) : (x))
 
+#ifdef FOOTERLESS
+#define PREVALLOC   0x2     /* header bit: previous block is allocated */
+#else
+#define PREVALLOC   0
+#endif
+#ifdef DEFER_COALESCE
+#define PENDING     0x4     /* header bit: free block not yet coalesced */
+#else
+#define PENDING     0
+#endif
+
+/* Adjusted block size for a request of size payload bytes */
+#ifdef FOOTERLESS
+#define ASIZE(size)  MAX(MINBLOCK, DSIZE * (((size) + WSIZE + (DSIZE - 1)) / DSIZE))
+#else
+#define ASIZE(size)  MAX(MINBLOCK, DSIZE * (((size) + OVERHEAD + (DSIZE - 1)) / DSIZE))
+#endif
+
+/* Payload bytes a growing realloc reserves for a request of size bytes */
+#ifdef REALLOC_HEADROOM
+#define HEADROOM(size)  ((size) + (size) / 2)
+#else
+#define HEADROOM(size)  (size)
+#endif
+
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc)  ((size) | (alloc))
 
 /* Read and write a word at address p */
-#define GET(p)       (*(size_t *)(p))
-#define PUT(p, val)  (*(size_t *)(p) = (val))  
+#define GET(p)       (*(word_t *)(p))
+#define PUT(p, val)  (*(word_t *)(p) = (val))  
 #define PUT_ADDR(p, val) (*(void **)(p) = (void *) (val))
 
 /* Read the size and allocated fields from address p */
-#define GET_SIZE(p)  (GET(p) & ~0x7)
+#ifdef THREAD_ARENAS
+#define GET_SIZE(p)  ((size_t)(GET(p) & ~0x7 & (((word_t)1 << TAG_SHIFT) - 1)))
+#else
+#define GET_SIZE(p)  ((size_t)(GET(p) & ~0x7))
+#endif
 #define GET_ALLOC(p) (GET(p) & 0x1)
 
+/* Read the previous-allocated field from header address p */
+#define GET_PREV_ALLOC(p) (GET(p) & PREVALLOC)
+
+/* Read the pending field from header address p */
+#define GET_PENDING(p) (GET(p) & PENDING)
+
+/* Tag bits written into every header and footer of the current arena */
+#ifdef THREAD_ARENAS
+#define ARENA_TAG      (ar->tag)
+/* read without the owner's lock, so it races with PUT_SHARED only */
+#define GET_TAG(p)     (__atomic_load_n((word_t *)(p), __ATOMIC_RELAXED) >> TAG_SHIFT)
+/* write a header that another thread may be reading the tag of */
+#define PUT_SHARED(p, val) __atomic_store_n((word_t *)(p), (val), __ATOMIC_RELAXED)
+#else
+#define PUT_SHARED(p, val) PUT(p, val)
+#define ARENA_TAG      0
+#endif
+
+/* Run statement s only in a STATS build */
+#ifdef STATS
+#define STAT(s)        do { s; } while (0)
+#else
+#define STAT(s)
+#endif
+
+/* Log one call when recording, else compile the call out */
+#ifdef RECORD
+#define REC(op, size, id) do { if (rec_on) rec_log(op, size, id); } while (0)
+#else
+#define REC(op, size, id)
+#endif
+
+/* Lock and unlock a mutex, or nothing in a single-threaded build */
+#ifdef THREAD_ARENAS
+#define LOCK(m)        pthread_mutex_lock(m)
+#define UNLOCK(m)      pthread_mutex_unlock(m)
+#else
+#define LOCK(m)
+#define UNLOCK(m)
+#endif
+
 /* Given block ptr bp, compute address of its header and footer */
 #define HDRP(bp)       ((char *)(bp) - WSIZE)  
 #define FTRP(bp)       ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
@@ -77,30 +323,286 @@ team_t team = {
 #define NXTP(bp)       ((char *)(bp))  
 #define PRVP(bp)       ((char *)(bp) + PSIZE)
 
+/* Given block ptr bp, compute its usable payload size */
+#ifdef FOOTERLESS
+#define PAYLOAD_SIZE(bp)  (GET_SIZE(HDRP(bp)) - WSIZE)
+#else
+#define PAYLOAD_SIZE(bp)  (GET_SIZE(HDRP(bp)) - OVERHEAD)
+#endif
+
 /* Given block ptr bp, compute address of next and previous blocks */
 #define NEXT_BLKP(bp)  ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
 #define PREV_BLKP(bp)  ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
 
+/* Given block ptr bp, read whether the previous block is allocated */
+#ifdef FOOTERLESS
+#define PREV_ALLOCATED(bp)  GET_PREV_ALLOC(HDRP(bp))
+#else
+#define PREV_ALLOCATED(bp)  GET_ALLOC(FTRP(PREV_BLKP(bp)))
+#endif
+
 /* Given block ptr bp, compute address of next and previous blocks in explicit list*/
 #define NEXT_BLKP_EX(bp)  (*(void **)(NXTP(bp)))
 #define PREV_BLKP_EX(bp)  (*(void **)(PRVP(bp)))
+
+/* Given treap block ptr bp, compute address of its left and right child pointer */
+#define LEFTP(bp)      ((char *)(bp) + 2*PSIZE)
+#define RIGHTP(bp)     ((char *)(bp) + 3*PSIZE)
+
+/* Given treap block ptr bp, compute its left and right child */
+#define LEFT_BLKP(bp)  (*(void **)(LEFTP(bp)))
+#define RIGHT_BLKP(bp) (*(void **)(RIGHTP(bp)))
+
+/* Given size class i, compute address of its sentinel node */
+#define SEG_HEAD(i)    ((char *)ar->seg_list + (i) * 2 * PSIZE)
+
+/* Given quick list block ptr bp, compute the next cached block */
+#define NEXT_BLKP_QL(bp)  (*(void **)(bp))
+
+/* Given remote freed block ptr bp, compute the next block on the stack */
+#define NEXT_BLKP_RF(bp)  (*(void **)(bp))
+
+/* Offset of the first object of size bytes in a slab run */
+#define SLAB_FIRST(size)  ((size) * ((sizeof(struct slab) + (size) - 1) / (size)))
+
+/* Number of objects of size bytes in a slab run */
+#define SLAB_OBJS(size)   ((SLAB_BYTES - SLAB_FIRST(size)) / (size))
+
+/* Given slab object ptr p, compute the next free object of its run */
+#define NEXT_OBJ(p)    (*(void **)(p))
+
+/* Given quick list bin i, compute address of its head pointer and block count */
+#define QL_HEAD(i)     ((char *)ar->ql_list + (i) * 2 * PSIZE)
+#define QL_COUNT(i)    ((char *)ar->ql_list + (i) * 2 * PSIZE + PSIZE)
+
+/* Given block ptr bp, compute its address index region (region_grow keeps it in range) */
+#define REGION(bp)     ((int)(((size_t)(bp) - addr_base) >> ar->region_shift))
+
+/* Address of the pending list sentinel */
+#define PEND_HEAD      ((char *)ar->pend_list)
+
+/* Given block ptr bp that is not a slab object, is it mapped, and how long is its mapping */
+#define IS_MAPPED(bp)  (GET_SIZE(HDRP(bp)) == 0)
+#define MAP_LEN(bp)    ((size_t)GET((char *)(bp) - DSIZE))
+
+/* Does p point into the heap */
+#define IN_HEAP(p)     ((char *)(p) >= (char *)mem_heap_lo() && (char *)(p) <= (char *)mem_heap_hi())
 /* $end mallocmacros */
 
-/* Global variables */
-static char *heap_listp = NULL;  /* pointer to first explicit block */
+/*
+ * Descriptor at the start of a slab run. The run is the payload of an
+ * allocated heap block of SLAB_RUN bytes and starts on a SLAB_RUN boundary,
+ * so the owner of an object is its address rounded down, and runs carved
+ * one after another tile the heap. Objects follow the descriptor.
+ */
+struct slab {
+    void *free;                  /* free objects, linked through their first word */
+    struct slab *next;           /* next run of the class with free objects */
+    struct slab *prev;           /* previous run of the class with free objects */
+    unsigned size;               /* object size (bytes) */
+    unsigned used;               /* objects handed out */
+};
+
+/*
+ * Free-list state of one arena. Every arena owns one or more chunks, each
+ * bounded by its own prologue and epilogue so coalescing never crosses
+ * into another arena. The arenas themselves live in front of the heap.
+ */
+struct arena {
+    char *heap_listp;            /* prologue of the first chunk, single list sentinel */
+    char *heap_end;              /* break just past the newest chunk's epilogue */
 #ifdef NEXT_FIT
-static char *rover;       /* next fit rover */
+    char *rover;                 /* next fit rover */
+#endif
+#ifdef SEG_FIT
+    void *seg_list[SEG_CLASSES * 2 * PSIZE / sizeof(void *)]; /* size class sentinels */
+#endif
+#ifdef QUICK_LIST
+    void *ql_list[QL_BINS * 2 * PSIZE / sizeof(void *)]; /* quick list bins */
+#endif
+#ifdef TREE_FIT
+    void *tree_root;             /* root of the large free block treap */
+#endif
+#ifdef DEFER_COALESCE
+    void *pend_list[2 * PSIZE / sizeof(void *)]; /* pending list sentinel */
+    size_t pend_count;           /* blocks on the pending list */
+#endif
+    size_t chunk_cur;            /* next heap extension (bytes) */
+    unsigned long malloc_count;  /* mm_malloc calls so far */
+    unsigned long grow_mark;     /* malloc_count at the last extension */
+#ifdef THREAD_ARENAS
+    char *last_chunk;            /* prologue of the newest chunk */
+    word_t tag;                  /* header tag naming this arena */
+    pthread_mutex_t lock;        /* held by every call into the arena */
+#endif
+#ifdef REMOTE_FREE
+    void *remote;                /* blocks freed by other threads, pushed by CAS */
+#endif
+#ifdef SLAB
+    struct slab *slab_list[SLAB_CLASSES]; /* runs with free objects, per class */
+#endif
+#ifdef STATS
+    struct mm_stats stats;       /* this arena's call, probe and live byte counts */
+#endif
+#ifdef ADDR_ORDER
+    char *region_last[ADDR_REGIONS]; /* highest listed free block per region */
+    unsigned long region_map[ADDR_REGIONS / LBITS]; /* regions with a listed block */
+    int region_shift;            /* log2 heap bytes per index region */
+#endif
+#ifdef CHECK_SAMPLE
+    char *check_chunk;           /* prologue of the chunk check_next is in */
+    char *check_next;            /* block the next sampled check starts at */
+#endif
+};
+
+/* Global variables */
+static struct arena *arenas;     /* the NARENAS arenas */
+#ifdef THREAD_ARENAS
+static __thread struct arena *ar; /* arena the calling thread is working in */
+static __thread int home = -1;   /* index of the calling thread's own arena */
+static unsigned next_home;       /* hands out home arenas round robin */
+static pthread_mutex_t sbrk_lock = PTHREAD_MUTEX_INITIALIZER; /* serializes mem_sbrk */
+#else
+static struct arena *ar;         /* the only arena */
+#endif
+
+/* Heap growth policy, read at mm_init time */
+static size_t chunk_min;         /* smallest heap extension (bytes) */
+static size_t chunk_max;         /* largest heap extension (bytes) */
+static size_t trim_threshold;    /* trim a trailing free block above this, 0 = never */
+#ifdef MMAP_LARGE
+static size_t mmap_threshold;    /* map requests of this many bytes and up, 0 = never */
+#endif
+#ifdef CHECK_SAMPLE
+static size_t check_budget;      /* blocks per arena per mm_checkheap, 0 = check all */
+#endif
+
+#ifdef ADDR_ORDER
+static size_t addr_base;         /* address where region 0 starts */
+#endif
+
+#ifdef STATS
+static unsigned long sbrk_calls; /* mem_sbrk calls so far */
+static size_t peak_heap;         /* largest heap size so far */
+#endif
+
+static char *heap_clean;         /* highest break so far; memory above it is still zero */
+
+#ifdef SLAB
+static unsigned char *slab_map;  /* one bit per SLAB_RUN page: page is a slab run */
+static size_t slab_base;         /* address of the page slab_map bit 0 stands for */
+#endif
+
+#ifdef RECORD
+#ifdef THREAD_ARENAS
+static __thread struct mm_rec_block *rec_blk; /* calling thread's log block, mapped */
+static __thread uint64_t rec_last; /* clock at the calling thread's last record */
+static pthread_key_t rec_key;    /* unmaps a thread's block when it exits */
+static pthread_mutex_t rec_lock = PTHREAD_MUTEX_INITIALIZER; /* serializes log growth */
+#else
+static struct mm_rec_block *rec_blk; /* the log block being filled, mapped */
+static uint64_t rec_last;        /* clock at the last record */
+#endif
+static int rec_fd = -1;          /* log file, -1 = not recording */
+static off_t rec_off;            /* file offset of the next unclaimed block */
+static off_t rec_size;           /* file size, grown REC_GROW blocks at a time */
+static volatile int rec_on;      /* calls are being logged */
 #endif
 
 /* function prototypes for internal helper routines */
+static int arena_init(struct arena *a, int id);
+static char *new_chunk(void);
+static struct arena *home_arena(void);
+static struct arena *block_arena(void *bp);
+static void *arena_malloc(size_t size);
+static void *block_malloc(size_t size);
+static void arena_free(void *bp);
+static void *arena_realloc(void *ptr, size_t size);
+static void checkarena(int verbose);
+static void checkstep(void *bp);
+static size_t checklist(void *head, int i, size_t limit);
+#ifdef CHECK_SAMPLE
+static void checksample(int verbose);
+#endif
+#ifdef REMOTE_FREE
+static void remote_push(void *bp);
+static void remote_drain(void);
+#endif
+#ifdef MMAP_LARGE
+static void *map_alloc(size_t size);
+static void map_free(void *bp);
+static void *map_realloc(void *ptr, size_t size);
+#endif
 static void *extend_heap(size_t words);
+static void *heap_sbrk(int incr);
+#ifdef STATS
+static size_t block_bytes(void *bp);
+static void stat_live(long delta);
+#endif
+#ifdef RECORD
+static void rec_open(void);
+static void rec_log(int op, size_t size, void *id);
+static struct mm_rec_block *rec_next(uint64_t now);
+#ifdef THREAD_ARENAS
+static void rec_close(void *blk);
+#endif
+static void rec_exit(void);
+static uint64_t rec_ticks(void);
+#endif
+static int align_heap(void);
+#ifdef HUGE_PAGES
+static void prefault(char *lo, size_t size);
+#endif
+static void *grow_heap(size_t asize);
+static void trim_heap(void *bp);
+static size_t env_size(const char *name, size_t dflt);
 static void place(void *bp, size_t asize);
+static void realloc_place(void *bp, size_t total, size_t target);
+static void *alloc_aligned(size_t size, size_t align);
+static void zero_dirty(char *bp, size_t bytes, char *clean);
 static void *find_fit(size_t asize);
+static void *list_fit(size_t asize);
 static void *coalesce(void *bp);
 static void printblock(void *bp); 
 static void checkblock(void *bp);
+static void setblock(void *bp, size_t size, int alloc);
+#ifdef QUICK_LIST
+static int ql_bin(size_t size);
+static void *ql_pop(size_t asize);
+static int ql_push(void *bp);
+static void ql_flush(int i);
+static int ql_flushall(void);
+#endif
 static void insertblock(void *bp);
 static void deleteblock(void *bp);
+#ifndef ADDR_ORDER
+static void *list_head(size_t size);
+#endif
+#ifdef ADDR_ORDER
+static void *addr_pred(void *bp);
+static int region_below(int r);
+static void region_grow(void);
+static void checkorder(void);
+#endif
+#ifdef DEFER_COALESCE
+static void pend_flush(void);
+#endif
+#ifdef SEG_FIT
+static int sizeclass(size_t size);
+#endif
+#ifdef TREE_FIT
+static void *tree_fit(size_t asize);
+static void tree_insert(void **link, void *bp);
+static void tree_delete(void **link, void *bp);
+static size_t checktree(void *bp, void *lo, void *hi);
+#endif
+#ifdef SLAB
+static struct slab *slab_of(void *p);
+static void *slab_alloc(size_t size);
+static void slab_free(struct slab *run, void *p);
+static struct slab *slab_new(int i);
+static void checkslab(struct slab *run, int i);
+#endif
 
 /* 
  * mm_init - Initialize the memory manager 
@@ -108,314 +610,2048 @@ static void deleteblock(void *bp);
 /* $begin mminit */
 int mm_init(void) 
 {
-    /* create the initial empty heap */
-    if ((heap_listp = mem_sbrk(4*WSIZE + 2*PSIZE)) == (void *)-1)
+    int i;
+
+    /* MM_CHUNKSIZE, MM_MAXCHUNK, MM_TRIM_THRESHOLD and MM_MMAP_THRESHOLD override the defaults */
+    chunk_min = DSIZE * ((env_size("MM_CHUNKSIZE", CHUNKSIZE) + (DSIZE - 1)) / DSIZE);
+    chunk_min = MAX(chunk_min, MINBLOCK);
+    chunk_max = MAX(chunk_min, env_size("MM_MAXCHUNK", MAXCHUNK));
+    trim_threshold = env_size("MM_TRIM_THRESHOLD", TRIM_THRESHOLD);
+#ifdef MMAP_LARGE
+    mmap_threshold = env_size("MM_MMAP_THRESHOLD", MMAP_THRESHOLD);
+#endif
+#ifdef CHECK_SAMPLE
+    check_budget = env_size("MM_CHECK_BUDGET", 0);
+#endif
+    STAT(sbrk_calls = 0; peak_heap = 0);
+#ifdef RECORD
+    rec_open();
+    REC(MM_REC_INIT, 0, NULL);
+#endif
+
+    if (align_heap() < 0)
 	return -1;
-    PUT(heap_listp, 0);                        /* alignment padding */
-    PUT(heap_listp+WSIZE, PACK(OVERHEAD+2*PSIZE, 1));  /* prologue header */
-    PUT_ADDR(heap_listp+DSIZE, NULL);
-    PUT_ADDR(heap_listp+DSIZE+PSIZE, NULL);
-    PUT(heap_listp+DSIZE+2*PSIZE, PACK(OVERHEAD+2*PSIZE, 1));  /* prologue footer */ 
-    PUT(heap_listp+WSIZE+DSIZE+2*PSIZE, PACK(0, 1));   /* epilogue header */
-    heap_listp += DSIZE;
 
+#ifdef SLAB
+    /* so does the slab page map, shared by all arenas */
+    if ((slab_map = heap_sbrk(DSIZE * ((SLAB_PAGES / 8 + (DSIZE - 1)) / DSIZE))) == (void *)-1)
+	return -1;
+    memset(slab_map, 0, SLAB_PAGES / 8);
+    slab_base = (size_t)mem_heap_lo() & ~(size_t)(SLAB_RUN - 1);
+#endif
 
-#ifdef NEXT_FIT
-    rover = heap_listp;
+#ifdef ADDR_ORDER
+    addr_base = (size_t)mem_heap_lo();
 #endif
 
-    /* Extend the empty heap with a free block of CHUNKSIZE bytes */
-    // if (extend_heap(CHUNKSIZE/WSIZE) == NULL)
-	// return -1;
+    /* The arenas live in front of the heap, like the prologue */
+    if ((arenas = heap_sbrk(DSIZE * ((NARENAS * sizeof(struct arena) + (DSIZE - 1)) / DSIZE)))
+	== (void *)-1)
+	return -1;
+    for (i = 0; i < NARENAS; i++)
+	if (arena_init(&arenas[i], i) < 0)
+	    return -1;
+#ifdef HUGE_PAGES
+    if (env_size("MM_PREFAULT", 0))
+	prefault(mem_heap_lo(), mem_heapsize());
+#endif
     return 0;
 }
 /* $end mminit */
 
 /* 
- * mm_malloc - Allocate a block with at least size bytes of payload 
+ * arena_init - Reset arena a, give it a first chunk and extend that
+ *     with a free block of chunk_min bytes
  */
-/* $begin mmmalloc */
-void *mm_malloc(size_t size) 
+static int arena_init(struct arena *a, int id)
 {
-	if (size == 0) {
-        return NULL;
+#if defined(SEG_FIT) || defined(QUICK_LIST) || defined(SLAB)
+    int i;
+#endif
+
+    ar = a;
+#ifdef THREAD_ARENAS
+    ar->tag = (word_t)id << TAG_SHIFT;
+    if (pthread_mutex_init(&ar->lock, NULL) != 0)
+	return -1;
+#else
+    (void)id;
+#endif
+    ar->chunk_cur = chunk_min;
+    ar->malloc_count = ar->grow_mark = 0;
+    STAT(memset(&ar->stats, 0, sizeof(ar->stats)));
+#ifdef REMOTE_FREE
+    ar->remote = NULL;
+#endif
+#ifdef SLAB
+    for (i = 0; i < SLAB_CLASSES; i++)
+	ar->slab_list[i] = NULL;
+#endif
+#ifdef ADDR_ORDER
+    memset(ar->region_last, 0, sizeof(ar->region_last));
+    memset(ar->region_map, 0, sizeof(ar->region_map));
+    ar->region_shift = ADDR_REGION_SHIFT;
+#endif
+
+#ifdef SEG_FIT
+    /* 
+     * Each size class sentinel is a bare next/prev pair,
+     * so deleteblock never sees a NULL prev.
+     */
+    for (i = 0; i < SEG_CLASSES; i++) {
+	PUT_ADDR(NXTP(SEG_HEAD(i)), NULL);
+	PUT_ADDR(PRVP(SEG_HEAD(i)), NULL);
     }
-    size_t realSize = DSIZE * ((size + OVERHEAD + 2 * PSIZE + (DSIZE - 1)) / DSIZE);
-    void *bp = find_fit(realSize);
-    if (bp != NULL) {
-        place(bp, realSize);
-        return bp;
+#endif
+
+#ifdef QUICK_LIST
+    for (i = 0; i < QL_BINS; i++) {
+	PUT_ADDR(QL_HEAD(i), NULL);
+	PUT(QL_COUNT(i), 0);
     }
-    bp = extend_heap(realSize / WSIZE);
-    if (bp == NULL) return NULL;
-    place(bp, realSize);
+#endif
 
-    return bp;
-} 
-/* $end mmmalloc */
+#ifdef DEFER_COALESCE
+    /* The pending list gets a sentinel of its own, like a size class */
+    PUT_ADDR(NXTP(PEND_HEAD), NULL);
+    PUT_ADDR(PRVP(PEND_HEAD), NULL);
+    ar->pend_count = 0;
+#endif
+
+    /* create the initial empty heap */
+    if ((ar->heap_listp = new_chunk()) == NULL)
+	return -1;
+#ifdef THREAD_ARENAS
+    ar->last_chunk = ar->heap_listp;
+#endif
+#ifdef NEXT_FIT
+    ar->rover = ar->heap_listp;
+#endif
+#ifdef TREE_FIT
+    ar->tree_root = NULL;
+#endif
+#ifdef CHECK_SAMPLE
+    ar->check_chunk = ar->check_next = ar->heap_listp;
+#endif
+
+    /* Extend the empty heap with a free block of chunk_min bytes */
+    if (extend_heap(chunk_min/WSIZE) == NULL)
+	return -1;
+    return 0;
+}
 
 /* 
- * mm_free - Free a block 
+ * new_chunk - Lay out an empty prologue and epilogue at the break and
+ *     return the prologue. The first chunk's prologue heads the single
+ *     free list; every prologue's prev pointer links to the next chunk.
  */
-/* $begin mmfree */
-void mm_free(void *bp)
+static char *new_chunk(void)
 {
-    if (!GET_ALLOC(HDRP(bp))) return;
-    PUT(HDRP(bp), GET_SIZE(HDRP(bp)));
-    PUT(FTRP(bp), GET_SIZE(HDRP(bp)));
-    coalesce(bp);
-}
+    char *p;
 
-/* $end mmfree */
+    if ((p = heap_sbrk(4*WSIZE + 2*PSIZE)) == (void *)-1)
+	return NULL;
+    PUT(p, 0);                        /* alignment padding */
+    PUT(p+WSIZE, PACK(OVERHEAD+2*PSIZE, 1) | ARENA_TAG | PREVALLOC);  /* prologue header */
+    PUT_ADDR(p+DSIZE, NULL);
+    PUT_ADDR(p+DSIZE+PSIZE, NULL);
+    PUT(p+DSIZE+2*PSIZE, PACK(OVERHEAD+2*PSIZE, 1) | ARENA_TAG);  /* prologue footer */ 
+    PUT(p+WSIZE+DSIZE+2*PSIZE, PACK(0, 1) | PREVALLOC);   /* epilogue header */
+    ar->heap_end = p + 4*WSIZE + 2*PSIZE;
+    return p + DSIZE;
+}
 
 /*
- * mm_realloc - naive implementation of mm_realloc
+ * home_arena - Return the calling thread's arena, handing one out
+ *     round robin on the thread's first call
  */
-void *mm_realloc(void *ptr, size_t size)
+static struct arena *home_arena(void)
 {
-    size_t realSize = DSIZE * ((size + OVERHEAD + 2 * PSIZE + (DSIZE - 1)) / DSIZE);
-    if (ptr == NULL) {
-        return mm_malloc(realSize);
-    } else if (size == 0) {
-        free(ptr);
-        return NULL;
-    }
-    size_t remainSize = GET_SIZE(HDRP(ptr)) - realSize;
-    //allocate within existing block
-    if (GET_SIZE(HDRP(ptr)) >= realSize) {
-        if (remainSize >= (DSIZE + 2 * PSIZE + OVERHEAD)) {
-            PUT(HDRP(ptr), PACK(realSize, 1));
-            PUT(FTRP(ptr), PACK(realSize, 1));
-            void *nxt = NEXT_BLKP(ptr);
-            PUT(HDRP(nxt), PACK(remainSize, 0));
-            PUT(FTRP(nxt), PACK(remainSize, 0));
-            insertblock(nxt);
-        } 
-        return ptr;
-    }
-    //extend block
-    void *nxt = NEXT_BLKP(ptr);
-    if (!GET_ALLOC(HDRP(nxt)) && (GET_SIZE(HDRP(nxt)) >= remainSize)) {
-        deleteblock(nxt);
-        size_t totalSize = GET_SIZE(HDRP(ptr)) + GET_SIZE(HDRP(nxt));
-        if ((totalSize - realSize) >= (DSIZE + 2 * PSIZE + OVERHEAD)) {
-            PUT(HDRP(ptr), PACK(realSize, 1));
-            PUT(FTRP(ptr), PACK(realSize, 1));
-            nxt = NEXT_BLKP(ptr);
-            PUT(HDRP(nxt), PACK(totalSize - realSize, 0));
-            PUT(FTRP(nxt), PACK(totalSize - realSize, 0));
-            insertblock(nxt);
-        } else {
-            PUT(HDRP(ptr), PACK(totalSize, 1));
-            PUT(FTRP(ptr), PACK(totalSize, 1));
-        }
-        return ptr;
-    } 
-    
-    //move block
-    void *bp = mm_malloc(realSize);
-    if (bp == NULL) return NULL;
-    size_t copySize = MIN(size, GET_SIZE(HDRP(ptr)));
-    memcpy(bp, ptr, copySize);
-    mm_free(ptr);
-    return bp;
+#ifdef THREAD_ARENAS
+    if (home < 0)
+	home = __sync_fetch_and_add(&next_home, 1) % NARENAS;
+    return &arenas[home];
+#else
+    return arenas;
+#endif
 }
 
-
-/* 
- * mm_checkheap - Check the heap for consistency 
+/*
+ * block_arena - Return the arena that owns block bp
  */
-void mm_checkheap(int verbose) 
+static struct arena *block_arena(void *bp)
 {
-    char *bp = heap_listp;
-
-    if (verbose)
-	printf("Heap (%p):\n", heap_listp);
-
-    if ((GET_SIZE(HDRP(heap_listp)) != DSIZE) || !GET_ALLOC(HDRP(heap_listp)))
-	printf("Bad prologue header\n");
-    checkblock(heap_listp);
+#ifdef THREAD_ARENAS
+#ifdef SLAB
+    struct slab *run = slab_of(bp);
 
-    for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
-	if (verbose) 
-	    printblock(bp);
-	checkblock(bp);
-    }
-     
-    if (verbose)
-	printblock(bp);
-    if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp))))
-	printf("Bad epilogue header\n");
+    if (run != NULL)
+	bp = run; /* objects belong to the arena of their run */
+#endif
+    return &arenas[GET_TAG(HDRP(bp))];
+#else
+    (void)bp;
+    return arenas;
+#endif
 }
 
-/* The remaining routines are internal helper routines */
-
 /* 
- * extend_heap - Extend heap with free block and return its block pointer
+ * mm_malloc - Allocate a block with at least size bytes of payload
+ *     from the calling thread's arena
  */
-/* $begin mmextendheap */
-static void *extend_heap(size_t words) 
+void *mm_malloc(size_t size)
 {
-    char *bp;
-    size_t size;
-	
-    /* Allocate an even number of words to maintain alignment */
-    size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
-    if ((bp = mem_sbrk(size)) == (void *)-1) 
-	return NULL;
+    void *bp;
 
-    /* Initialize free block header/footer and the epilogue header */
-    PUT(HDRP(bp), PACK(size, 0));         /* free block header */
-    PUT(FTRP(bp), PACK(size, 0));         /* free block footer */
-    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* new epilogue header */
-    /* Coalesce if the previous block was free */
-    return coalesce(bp);
+    ar = home_arena();
+    LOCK(&ar->lock);
+    bp = arena_malloc(size);
+    STAT(ar->stats.mallocs++; if (bp != NULL) stat_live(block_bytes(bp)));
+    UNLOCK(&ar->lock);
+    REC(MM_REC_MALLOC, size, bp);
+    return bp;
 }
-/* $end mmextendheap */
 
 /* 
- * place - Place block of asize bytes at start of free block bp 
- *         and split if remainder would be at least minimum block size
+ * mm_free - Free a block into the arena it came from. With REMOTE_FREE
+ *     a block of another thread's arena is queued without its lock.
  */
-/* $begin mmplace */
-/* $begin mmplace-proto */
-static void place(void *bp, size_t asize)
-/* $end mmplace-proto */
+void mm_free(void *bp)
 {
-    size_t csize = GET_SIZE(HDRP(bp));   
-
-    deleteblock(bp);
-    if ((csize - asize) >= (DSIZE + 2 * PSIZE + OVERHEAD)) { 
-	PUT(HDRP(bp), PACK(asize, 1));
-	PUT(FTRP(bp), PACK(asize, 1));
-	bp = NEXT_BLKP(bp);
-	PUT(HDRP(bp), PACK(csize-asize, 0));
-	PUT(FTRP(bp), PACK(csize-asize, 0));
-    insertblock(bp);
+    if (bp == NULL)
+	return;
+    REC(MM_REC_FREE, 0, bp);
+    ar = block_arena(bp);
+#ifdef REMOTE_FREE
+    if (ar != home_arena()) {
+	remote_push(bp);
+	return;
     }
-    else { 
-	PUT(HDRP(bp), PACK(csize, 1));
-	PUT(FTRP(bp), PACK(csize, 1));
+#endif
+    LOCK(&ar->lock);
+    STAT(ar->stats.frees++; stat_live(-(long)block_bytes(bp)));
+    arena_free(bp);
+    UNLOCK(&ar->lock);
+}
+
+/*
+ * mm_realloc - Resize a block within the arena it came from
+ */
+void *mm_realloc(void *ptr, size_t size)
+{
+    void *bp;
+
+    if (ptr == NULL)
+	return mm_malloc(size);
+    REC(MM_REC_REALLOC, size, ptr);
+    ar = block_arena(ptr);
+    LOCK(&ar->lock);
+    STAT(ar->stats.reallocs++; stat_live(-(long)block_bytes(ptr)));
+    bp = arena_realloc(ptr, size);
+    STAT(if (bp != NULL) stat_live(block_bytes(bp)));
+    UNLOCK(&ar->lock);
+    REC(MM_REC_RESULT, 0, bp);
+    return bp;
+}
+
+/*
+ * mm_calloc - Allocate nmemb * size zeroed bytes. Only the parts of the
+ *     block the heap may have written before are cleared.
+ */
+void *mm_calloc(size_t nmemb, size_t size)
+{
+    size_t bytes = nmemb * size;
+    char *clean;
+    void *bp;
+
+    if (size != 0 && bytes / size != nmemb)
+	return NULL;
+    ar = home_arena();
+    LOCK(&ar->lock);
+    LOCK(&sbrk_lock);
+    clean = heap_clean;
+    UNLOCK(&sbrk_lock);
+    bp = arena_malloc(bytes);
+    STAT(ar->stats.mallocs++; if (bp != NULL) stat_live(block_bytes(bp)));
+    UNLOCK(&ar->lock);
+    if (bp != NULL)
+	zero_dirty(bp, bytes, clean);
+    REC(MM_REC_MALLOC, bytes, bp);
+    return bp;
+}
+
+/*
+ * mm_memalign - Allocate a block whose payload starts on an align
+ *     boundary, align being a power of two
+ */
+void *mm_memalign(size_t align, size_t size)
+{
+    void *bp;
+
+    if (align == 0 || (align & (align - 1)))
+	return NULL;
+    if (align <= DSIZE)
+	return mm_malloc(size);
+    if (size == 0)
+	return NULL;
+    ar = home_arena();
+    LOCK(&ar->lock);
+    bp = alloc_aligned(size, align);
+    STAT(ar->stats.mallocs++; if (bp != NULL) stat_live(block_bytes(bp)));
+    UNLOCK(&ar->lock);
+    REC(MM_REC_MALLOC, size, bp);
+    return bp;
+}
+
+/* 
+ * mm_checkheap - Check every arena for consistency 
+ */
+void mm_checkheap(int verbose) 
+{
+    int i;
+
+    for (i = 0; i < NARENAS; i++) {
+	ar = &arenas[i];
+	LOCK(&ar->lock);
+#ifdef CHECK_SAMPLE
+	if (check_budget)
+	    checksample(verbose);
+	else
+#endif
+	checkarena(verbose);
+	UNLOCK(&ar->lock);
     }
 }
-/* $end mmplace */
 
+#ifdef STATS
 /* 
- * find_fit - Find a fit for a block with asize bytes 
+ * mm_stats - Sum the counters of every arena into out, and count the
+ *     free blocks of each size class by walking the heap
  */
-static void *find_fit(size_t asize)
+void mm_stats(struct mm_stats *out)
 {
-#ifdef NEXT_FIT 
-    /* next fit search */
-    char *oldrover = rover;
+    char *chunk, *bp;
+    int i, c;
 
-    /* search from the rover to the end of list */
-    for (; rover != NULL; rover = NEXT_BLKP_EX(rover))
-	if (!GET_ALLOC(rover) && asize <= GET_SIZE(HDRP(rover))){
-	    return rover;
+    memset(out, 0, sizeof(*out));
+    for (i = 0; i < NARENAS; i++) {
+	ar = &arenas[i];
+	LOCK(&ar->lock);
+	out->mallocs += ar->stats.mallocs;
+	out->frees += ar->stats.frees;
+	out->reallocs += ar->stats.reallocs;
+	out->fit_probes += ar->stats.fit_probes;
+	out->bytes_live += ar->stats.bytes_live;
+	out->peak_live += ar->stats.peak_live;
+	for (chunk = ar->heap_listp; chunk != NULL; chunk = PREV_BLKP_EX(chunk)) {
+	    for (bp = chunk; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+		if (GET_ALLOC(HDRP(bp)))
+		    continue;
+		/* class c holds blocks up to MINBLOCK << c, like sizeclass */
+		for (c = 0; c < MM_STATS_CLASSES - 1 && GET_SIZE(HDRP(bp)) > ((size_t)MINBLOCK << c); c++)
+		    ;
+		out->free_blocks[c]++;
+	    }
+	}
+	UNLOCK(&ar->lock);
     }
+    LOCK(&sbrk_lock);
+    out->sbrk_calls = sbrk_calls;
+    out->heap_bytes = mem_heapsize();
+    out->peak_heap = peak_heap;
+    UNLOCK(&sbrk_lock);
+}
+#endif
 
-    // /* search from start of list to old rover */
-    for (rover = NEXT_BLKP_EX(heap_listp); rover != NULL; rover = NEXT_BLKP_EX(rover))
-	if (asize <= GET_SIZE(HDRP(rover))) {
-	    return rover;
+#ifdef RECORD
+/*
+ * mm_record - Pause or resume logging to the MM_TRACE file
+ */
+void mm_record(int on)
+{
+    rec_on = on && rec_fd >= 0;
+}
+#endif
+
+/* 
+ * arena_malloc - Allocate a block with at least size bytes of payload 
+ */
+/* $begin mmmalloc */
+static void *arena_malloc(size_t size) 
+{
+	if (size == 0) {
+        return NULL;
     }
+    ar->malloc_count++;
+#ifdef REMOTE_FREE
+    remote_drain();
+#endif
+#ifdef MMAP_LARGE
+    if (mmap_threshold && size >= mmap_threshold)
+        return map_alloc(size);
+#endif
+#ifdef SLAB
+    void *bp;
+    if (size <= SLAB_MAXOBJ && (bp = slab_alloc(size)) != NULL)
+        return bp;
+#endif
+    return block_malloc(size);
+}
+/* $end mmmalloc */
 
-    return NULL;  /* no fit found */
-#else 
-    /* first fit search */
+/*
+ * block_malloc - Allocate a heap block, never a slab object or a mapping
+ */
+static void *block_malloc(size_t size)
+{
+    size_t realSize = ASIZE(size);
     void *bp;
 
-    for (bp = NEXT_BLKP_EX(heap_listp); bp != NULL; bp = NEXT_BLKP_EX(bp)) {
-	if (asize <= GET_SIZE(HDRP(bp))) {
-	    return bp;
-	}
+#ifdef QUICK_LIST
+    if ((bp = ql_pop(realSize)) != NULL)
+        return bp;
+#endif
+    bp = find_fit(realSize);
+    if (bp != NULL) {
+        place(bp, realSize);
+        return bp;
+    }
+#ifdef DEFER_COALESCE
+    /* coalescing the pending blocks may turn up a fit */
+    if (ar->pend_count > 0) {
+        pend_flush();
+        if ((bp = find_fit(realSize)) != NULL) {
+            place(bp, realSize);
+            return bp;
+        }
+    }
+#endif
+#ifdef QUICK_LIST
+    /* cached blocks may hide a fit, so flush them before growing the heap */
+    if (ql_flushall() && (bp = find_fit(realSize)) != NULL) {
+        place(bp, realSize);
+        return bp;
     }
-    return NULL; /* no fit */
 #endif
+    bp = grow_heap(realSize);
+    if (bp == NULL) return NULL;
+    place(bp, realSize);
+
+    return bp;
 }
 
-/*
- * coalesce - boundary tag coalescing. Return ptr to coalesced block
+/* 
+ * arena_free - Free a block 
  */
-static void *coalesce(void *bp) 
+/* $begin mmfree */
+static void arena_free(void *bp)
 {
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
-    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
-    size_t size = GET_SIZE(HDRP(bp));
+#ifdef SLAB
+    struct slab *run = slab_of(bp);
 
-    if (!prev_alloc) {
-        void *prv = PREV_BLKP(bp);
-        size += GET_SIZE(HDRP(prv));
-        PUT(FTRP(bp), PACK(size, 0));
-        PUT(HDRP(prv), PACK(size, 0));
-        deleteblock(prv);
-        bp = prv;
+    if (run != NULL) {
+        slab_free(run, bp);
+        return;
+    }
+#endif
+#ifdef MMAP_LARGE
+    if (IS_MAPPED(bp)) {
+        map_free(bp);
+        return;
     }
+#endif
+    if (!GET_ALLOC(HDRP(bp))) return;
+#ifdef QUICK_LIST
+    if (ql_push(bp)) return;
+#endif
+    setblock(bp, GET_SIZE(HDRP(bp)), 0);
+#ifdef DEFER_COALESCE
+    /* park the block on the pending list, flush once the list is full */
+    PUT(HDRP(bp), GET(HDRP(bp)) | PENDING);
+    insertblock(bp);
+    if (ar->pend_count >= DEFER_MAX)
+        pend_flush();
+    return;
+#endif
+    bp = coalesce(bp);
+    if (trim_threshold && GET_SIZE(HDRP(NEXT_BLKP(bp))) == 0 &&
+        GET_SIZE(HDRP(bp)) > trim_threshold)
+        trim_heap(bp);
+}
 
-    if (!next_alloc) {
-        void *nxt = NEXT_BLKP(bp);
-        size += GET_SIZE(HDRP(nxt));
-        deleteblock(nxt);
-        PUT(HDRP(bp), PACK(size, 0));
-        PUT(FTRP(bp), PACK(size, 0));
+/* $end mmfree */
+
+/*
+ * arena_realloc - Resize a block in place whenever its neighbours allow it:
+ *     grow into a free next block, extend the heap when the block is
+ *     last, or slide back into a free previous block. Only copy to a new
+ *     block when none of these fit.
+ */
+static void *arena_realloc(void *ptr, size_t size)
+{
+    size_t asize, target, oldsize, total;
+    void *nxt, *prv, *bp;
+
+    if (size == 0) {
+        arena_free(ptr);
+        return NULL;
     }
+#ifdef SLAB
+    struct slab *run = slab_of(ptr);
 
-    insertblock(bp);
+    //slab objects only move when they outgrow their class
+    if (run != NULL) {
+        if (size <= run->size)
+            return ptr;
+        if ((bp = arena_malloc(HEADROOM(size))) == NULL)
+            return NULL;
+        memcpy(bp, ptr, run->size);
+        slab_free(run, ptr);
+        return bp;
+    }
+#endif
+#ifdef MMAP_LARGE
+    if (IS_MAPPED(ptr))
+        return map_realloc(ptr, size);
+#endif
+    asize = ASIZE(size);
+    target = ASIZE(HEADROOM(size));
+    oldsize = GET_SIZE(HDRP(ptr));
 
-#ifdef NEXT_FIT
-    /* Make sure the rover isn't pointing into the free block */
-    /* that we just coalesced */
-    if ((rover > (char *)bp) && (rover < NEXT_BLKP(bp))) {
-        rover = bp;
+    //allocate within existing block
+    if (oldsize >= asize) {
+        realloc_place(ptr, oldsize, target);
+        return ptr;
     }
+
+#ifdef MMAP_LARGE
+    //a block grown past the threshold leaves the heap
+    if (mmap_threshold && size >= mmap_threshold)
+        goto move;
 #endif
 
+    nxt = NEXT_BLKP(ptr);
+    total = oldsize;
+    if (!GET_ALLOC(HDRP(nxt)))
+        total += GET_SIZE(HDRP(nxt));
+
+    //last block in the heap: sbrk just the missing bytes
+    if (total < target &&
+        (GET_ALLOC(HDRP(nxt)) ? nxt : NEXT_BLKP(nxt)) == ar->heap_end &&
+        extend_heap(MAX(target - total, MINBLOCK) / WSIZE) != NULL) {
+        nxt = NEXT_BLKP(ptr);
+        total = oldsize + GET_SIZE(HDRP(nxt));
+    }
+
+    //extend block into the next free block
+    if (!GET_ALLOC(HDRP(nxt)) && total >= asize) {
+        deleteblock(nxt);
+        realloc_place(ptr, total, target);
+        return ptr;
+    }
+
+    //slide block back over a free previous block
+    if (!PREV_ALLOCATED(ptr)) {
+        prv = PREV_BLKP(ptr);
+        total += GET_SIZE(HDRP(prv));
+        if (total >= asize) {
+            deleteblock(prv);
+            if (!GET_ALLOC(HDRP(nxt)))
+                deleteblock(nxt);
+            memmove(prv, ptr, PAYLOAD_SIZE(ptr));
+            realloc_place(prv, total, target);
+            return prv;
+        }
+    }
+
+    //move block
+#ifdef MMAP_LARGE
+ move:
+#endif
+    bp = arena_malloc(HEADROOM(size));
+    if (bp == NULL) return NULL;
+    memcpy(bp, ptr, MIN(size, PAYLOAD_SIZE(ptr)));
+    arena_free(ptr);
     return bp;
 }
 
 
-static void printblock(void *bp) 
+/* 
+ * checkarena - Check the current arena for consistency 
+ */
+static void checkarena(int verbose) 
 {
-    size_t hsize, halloc, fsize, falloc;
+    char *chunk, *bp;
+    size_t free_blocks = 0, listed = 0;
 
-    hsize = GET_SIZE(HDRP(bp));
-    halloc = GET_ALLOC(HDRP(bp));  
-    fsize = GET_SIZE(FTRP(bp));
-    falloc = GET_ALLOC(FTRP(bp));  
-    
-    if (hsize == 0) {
-	printf("%p: EOL\n", bp);
-	return;
+    if (verbose)
+	printf("Heap (%p):\n", ar->heap_listp);
+
+#ifdef DEFER_COALESCE
+    size_t pending = 0;
+#endif
+
+    for (chunk = ar->heap_listp; chunk != NULL; chunk = PREV_BLKP_EX(chunk)) {
+	if ((GET_SIZE(HDRP(chunk)) != OVERHEAD + 2*PSIZE) || !GET_ALLOC(HDRP(chunk)))
+	    printf("Bad prologue header\n");
+
+	for (bp = chunk; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+	    if (verbose) 
+		printblock(bp);
+	    checkstep(bp);
+	    if (!GET_ALLOC(HDRP(bp)))
+		free_blocks++;
+#ifdef DEFER_COALESCE
+	    if (GET_PENDING(HDRP(bp)))
+		pending++;
+#endif
+	}
+     
+	if (verbose)
+	    printblock(bp);
+	if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp))))
+	    printf("Bad epilogue header\n");
+    }
+
+    /* every free block is on exactly one list, or in the treap */
+#ifdef SEG_FIT
+    for (int i = 0; i < SEG_CLASSES; i++)
+	listed += checklist(SEG_HEAD(i), i, free_blocks);
+#else
+    listed += checklist(ar->heap_listp, -1, free_blocks);
+#endif
+#ifdef TREE_FIT
+    listed += checktree(ar->tree_root, NULL, NULL);
+#endif
+
+#ifdef DEFER_COALESCE
+    /* every pending block sits on the pending list and nowhere else */
+    if (pending != ar->pend_count)
+	printf("Error: %lu pending blocks in heap, %lu counted\n",
+	       (unsigned long)pending, (unsigned long)ar->pend_count);
+    pending = checklist(PEND_HEAD, -1, free_blocks);
+    if (pending != ar->pend_count)
+	printf("Error: pending list holds %lu blocks, %lu counted\n",
+	       (unsigned long)pending, (unsigned long)ar->pend_count);
+    listed += pending;
+#endif
+    if (listed != free_blocks)
+	printf("Error: %lu free blocks in heap, %lu on the free lists\n",
+	       (unsigned long)free_blocks, (unsigned long)listed);
+
+#ifdef REMOTE_FREE
+    /* queued blocks stay allocated until the arena drains them */
+    for (bp = __atomic_load_n(&ar->remote, __ATOMIC_ACQUIRE); bp != NULL; bp = NEXT_BLKP_RF(bp))
+#ifdef SLAB
+	if (slab_of(bp) != NULL ? block_arena(bp) != ar : !GET_ALLOC(HDRP(bp)) || block_arena(bp) != ar)
+#else
+	if (!GET_ALLOC(HDRP(bp)) || block_arena(bp) != ar)
+#endif
+	    printf("Error: %p on remote free stack is not an allocated block of this arena\n", bp);
+#endif
+
+#ifdef ADDR_ORDER
+    checkorder();
+#endif
+
+#ifdef SLAB
+    for (int i = 0; i < SLAB_CLASSES; i++) {
+	struct slab *run;
+
+	for (run = ar->slab_list[i]; run != NULL; run = run->next)
+	    checkslab(run, i);
     }
+#endif
+
+#ifdef TREE_FIT
+    if (verbose)
+	printf("Treap: %lu large free blocks\n",
+	       (unsigned long)checktree(ar->tree_root, NULL, NULL));
+#endif
 
-    fprintf(stderr, "%p: header: [%d:%c] footer: [%d:%c]\n", bp, 
-	   hsize, (halloc ? 'a' : 'f'), 
-	   fsize, (falloc ? 'a' : 'f')); 
+#ifdef QUICK_LIST
+    /* cached blocks must still look allocated and sit in their own bin */
+    for (int i = 0; i < QL_BINS; i++) {
+	size_t count = 0;
+	for (bp = NEXT_BLKP_QL(QL_HEAD(i)); bp != NULL; bp = NEXT_BLKP_QL(bp)) {
+	    if (!GET_ALLOC(HDRP(bp)))
+		printf("Error: %p in quick list %d is not allocated\n", bp, i);
+	    if (ql_bin(GET_SIZE(HDRP(bp))) != i)
+		printf("Error: %p in quick list %d has the wrong size\n", bp, i);
+	    count++;
+	}
+	if (count != GET(QL_COUNT(i)))
+	    printf("Error: quick list %d count does not match\n", i);
+    }
+#endif
 }
 
-static void checkblock(void *bp) 
+/*
+ * checkstep - Check block bp of an implicit walk: its tags, its
+ *     neighbour, and for a listed free block its list links
+ */
+static void checkstep(void *bp)
 {
-    if ((size_t)bp % 8)
-	printf("Error: %p is not doubleword aligned\n", bp);
-    if (GET(HDRP(bp)) != GET(FTRP(bp)))
-	printf("Error: header does not match footer\n");
+    char *next = NEXT_BLKP(bp);
+    void *prv, *nxt;
+
+    checkblock(bp);
+#ifdef FOOTERLESS
+    if (!GET_ALLOC(HDRP(bp)) != !GET_PREV_ALLOC(HDRP(next)))
+	printf("Error: %p previous-allocated bit is stale\n", next);
+#endif
+    if (GET_ALLOC(HDRP(bp)))
+	return;
+    /* pending blocks wait to be coalesced, everything else is */
+    if (GET_SIZE(HDRP(next)) > 0 && !GET_ALLOC(HDRP(next)) &&
+	!GET_PENDING(HDRP(bp)) && !GET_PENDING(HDRP(next)))
+	printf("Error: %p and %p are adjacent free blocks\n", bp, next);
+#ifdef TREE_FIT
+    if (!GET_PENDING(HDRP(bp)) && GET_SIZE(HDRP(bp)) >= TREE_MINSIZE)
+	return;                       /* linked into the treap, see checktree */
+#endif
+    prv = PREV_BLKP_EX(bp);
+    nxt = NEXT_BLKP_EX(bp);
+    if (!IN_HEAP(prv) || NEXT_BLKP_EX(prv) != bp)
+	printf("Error: %p is not linked from its prev %p\n", bp, prv);
+    if (nxt != NULL && (!IN_HEAP(nxt) || PREV_BLKP_EX(nxt) != bp))
+	printf("Error: %p is not linked back from its next %p\n", bp, nxt);
 }
 
-static void insertblock(void *bp) {
-    void *tmp = NEXT_BLKP_EX(heap_listp);
-    PUT_ADDR(NXTP(bp), tmp);
-    if (tmp != NULL) PUT_ADDR(PRVP(tmp), bp);
-    PUT_ADDR(PRVP(bp), heap_listp);
-    PUT_ADDR(NXTP(heap_listp), bp);
+/*
+ * checklist - Check the free list behind sentinel head, size class i
+ *     or -1, and return its length. Stops after limit + 1 blocks, as a
+ *     longer list must have a cycle or a stray block.
+ */
+static size_t checklist(void *head, int i, size_t limit)
+{
+    void *prv = head, *bp;
+    size_t n = 0;
+
+    for (bp = NEXT_BLKP_EX(head); bp != NULL; prv = bp, bp = NEXT_BLKP_EX(bp)) {
+	if (!IN_HEAP(bp) || (size_t)bp % DSIZE) {
+	    printf("Error: %p on free list %p is not a heap block\n", bp, head);
+	    break;
+	}
+	if (++n > limit) {
+	    printf("Error: free list %p holds more blocks than the heap\n", head);
+	    break;
+	}
+	if (GET_ALLOC(HDRP(bp)))
+	    printf("Error: %p on free list %p is allocated\n", bp, head);
+	if (PREV_BLKP_EX(bp) != prv)
+	    printf("Error: %p prev is %p, not %p\n", bp, PREV_BLKP_EX(bp), prv);
+#ifdef DEFER_COALESCE
+	if (!GET_PENDING(HDRP(bp)) != (head != PEND_HEAD))
+	    printf("Error: %p is %spending but on free list %p\n", bp,
+		   GET_PENDING(HDRP(bp)) ? "" : "not ", head);
+#endif
+#ifdef SEG_FIT
+	if (i >= 0 && sizeclass(GET_SIZE(HDRP(bp))) != i)
+	    printf("Error: %p is on size class list %d\n", bp, i);
+#else
+	(void)i;
+#endif
+#ifdef TREE_FIT
+	if (!GET_PENDING(HDRP(bp)) && GET_SIZE(HDRP(bp)) >= TREE_MINSIZE)
+	    printf("Error: %p on free list %p belongs in the treap\n", bp, head);
+#endif
+    }
+    return n;
 }
 
-static void deleteblock(void *bp) {
-    #ifdef NEXT_FIT
-        if (rover == bp) rover = NEXT_BLKP_EX(bp);
-    #endif
-    void *nxt = NEXT_BLKP_EX(bp);
-    void *prv = PREV_BLKP_EX(bp);
-    if (nxt != NULL) PUT_ADDR(PRVP(nxt), prv);
-    PUT_ADDR(NXTP(prv), nxt);
+#ifdef CHECK_SAMPLE
+/*
+ * checksample - Check the next check_budget blocks of the current arena,
+ *     wrapping from the last chunk to the first. The whole lists are not
+ *     walked; each free block is checked against its list neighbours.
+ *     setblock moves check_next to the start of any block swallowing it.
+ */
+static void checksample(int verbose)
+{
+    char *bp = ar->check_next, *next;
+    size_t n;
+
+    for (n = 0; n < check_budget; n++) {
+	if (bp == ar->check_chunk &&
+	    ((GET_SIZE(HDRP(bp)) != OVERHEAD + 2*PSIZE) || !GET_ALLOC(HDRP(bp))))
+	    printf("Bad prologue header\n");
+	if (verbose)
+	    printblock(bp);
+	checkstep(bp);
+	next = NEXT_BLKP(bp);
+	if (GET_SIZE(HDRP(next)) == 0) {
+	    if (!GET_ALLOC(HDRP(next)))
+		printf("Bad epilogue header\n");
+	    /* the cursor never rests on an epilogue, trim_heap may move it */
+	    if ((ar->check_chunk = PREV_BLKP_EX(ar->check_chunk)) == NULL)
+		ar->check_chunk = ar->heap_listp;
+	    next = ar->check_chunk;
+	}
+	bp = next;
+    }
+    ar->check_next = bp;
+}
+#endif
+
+#ifdef MMAP_LARGE
+/*
+ * map_alloc - Give a request a mapping of its own. The payload follows
+ *     the length word and a size 0 header tagged with the current arena,
+ *     so mm_free finds the arena as it does for heap blocks.
+ */
+static void *map_alloc(size_t size)
+{
+    size_t len = MAP_PAGE * ((size + DSIZE + (MAP_PAGE - 1)) / MAP_PAGE);
+    char *p;
+
+    if (len < size || (word_t)len != len)
+	return NULL;
+    if ((p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0))
+	== MAP_FAILED)
+	return NULL;
+    PUT(p, len);
+    PUT(p + WSIZE, PACK(0, 1) | ARENA_TAG);
+    return p + DSIZE;
+}
+
+/*
+ * map_free - Unmap a mapped block
+ */
+static void map_free(void *bp)
+{
+    munmap((char *)bp - DSIZE, MAP_LEN(bp));
 }
+
+/*
+ * map_realloc - Resize a mapped block with mremap, which moves pages
+ *     rather than copying them. A block shrunk below half the threshold
+ *     is copied back into the heap.
+ */
+static void *map_realloc(void *ptr, size_t size)
+{
+    size_t len = MAP_PAGE * ((size + DSIZE + (MAP_PAGE - 1)) / MAP_PAGE);
+    char *p;
+
+    if (size < mmap_threshold / 2) {
+	if ((p = arena_malloc(size)) == NULL)
+	    return NULL;
+	memcpy(p, ptr, size);
+	map_free(ptr);
+	return p;
+    }
+    if (len < size || (word_t)len != len)
+	return NULL;
+    if (len == MAP_LEN(ptr))
+	return ptr;
+    if ((p = mremap((char *)ptr - DSIZE, MAP_LEN(ptr), len, MREMAP_MAYMOVE)) == MAP_FAILED)
+	return NULL;
+    PUT(p, len);
+    return p + DSIZE;
+}
+#endif
+
+/* 
+ * extend_heap - Extend heap with free block and return its block pointer
+ */
+/* $begin mmextendheap */
+static void *extend_heap(size_t words) 
+{
+    char *bp;
+    size_t size;
+	
+    /* Allocate an even number of words to maintain alignment */
+    size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
+    LOCK(&sbrk_lock);
+#ifdef THREAD_ARENAS
+    /* another arena moved the break, so grow a new chunk instead */
+    if (ar->heap_end != (char *)mem_heap_hi() + 1) {
+	if ((bp = new_chunk()) == NULL) {
+	    UNLOCK(&sbrk_lock);
+	    return NULL;
+	}
+	PUT_ADDR(PRVP(ar->last_chunk), bp);
+	ar->last_chunk = bp;
+    }
+#endif
+#ifdef HUGE_PAGES
+    /* round up to the next huge page boundary, the extra joins the free block */
+    size += (HUGE_PAGE - ((size_t)mem_heap_hi() + 1 + size) % HUGE_PAGE) % HUGE_PAGE;
+#endif
+    if ((bp = heap_sbrk(size)) == (void *)-1) {
+	UNLOCK(&sbrk_lock);
+	return NULL;
+    }
+    ar->heap_end = bp + size;
+    UNLOCK(&sbrk_lock);
+#ifdef ADDR_ORDER
+    region_grow();
+#endif
+
+    /* Initialize free block header/footer and the epilogue header */
+    setblock(bp, size, 0);                /* free block header/footer */
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* new epilogue header */
+    /* Coalesce if the previous block was free */
+    return coalesce(bp);
+}
+/* $end mmextendheap */
+
+/* 
+ * grow_heap - Extend the heap so that a block of asize bytes fits at its
+ *     end. A trailing free block only has to be topped up. Extensions are
+ *     at least chunk_cur bytes, which doubles (up to chunk_max) while
+ *     extensions come fewer than GROW_WINDOW mallocs apart and falls back
+ *     to chunk_min otherwise. Return the coalesced free block.
+ */
+static void *grow_heap(size_t asize)
+{
+    char *epilogue = ar->heap_end;
+    void *bp;
+    size_t tail = 0;
+    size_t chunk;
+
+    if (!PREV_ALLOCATED(epilogue))
+	tail = GET_SIZE(HDRP(PREV_BLKP(epilogue)));
+
+    if (ar->grow_mark != 0 && ar->malloc_count - ar->grow_mark < GROW_WINDOW)
+	ar->chunk_cur = MIN(2 * ar->chunk_cur, chunk_max);
+    else
+	ar->chunk_cur = chunk_min;
+    ar->grow_mark = ar->malloc_count;
+
+    chunk = (asize > tail) ? asize - tail : 0;
+    chunk = MAX(chunk, ar->chunk_cur);
+    bp = extend_heap(chunk / WSIZE);
+    /* the tail was not topped up if the extension opened a new chunk */
+    if (bp != NULL && GET_SIZE(HDRP(bp)) < asize)
+	bp = extend_heap(MAX(asize, ar->chunk_cur) / WSIZE);
+    return bp;
+}
+
+/* 
+ * trim_heap - Give all but chunk_min bytes of the trailing free block bp
+ *     back to sbrk. Nothing happens if sbrk cannot shrink the heap.
+ */
+static void trim_heap(void *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t release;
+
+    if (size <= chunk_min + MINBLOCK || NEXT_BLKP(bp) != ar->heap_end)
+	return;
+    release = MIN(size - chunk_min, (size_t)(0x7fffffff / DSIZE) * DSIZE);
+    release = DSIZE * (release / DSIZE);
+
+    deleteblock(bp);
+    LOCK(&sbrk_lock);
+    /* only the chunk at the break can shrink */
+    if (ar->heap_end != (char *)mem_heap_hi() + 1 ||
+	heap_sbrk(-(int)release) == (void *)-1) {
+	UNLOCK(&sbrk_lock);
+	insertblock(bp);
+	return;
+    }
+    ar->heap_end -= release;
+    UNLOCK(&sbrk_lock);
+    setblock(bp, size - release, 0);
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* new epilogue header */
+    insertblock(bp);
+    ar->chunk_cur = chunk_min;
+}
+
+/* 
+ * env_size - Read a byte count from environment variable name, or dflt
+ */
+static size_t env_size(const char *name, size_t dflt)
+{
+    char *val = getenv(name);
+
+    return (val != NULL && *val != '\0') ? (size_t)strtoul(val, NULL, 0) : dflt;
+}
+
+/* 
+ * heap_sbrk - mem_sbrk, counted. Callers hold sbrk_lock once threads run.
+ */
+static void *heap_sbrk(int incr)
+{
+    void *p = mem_sbrk(incr);
+
+    if (p != (void *)-1 && (char *)p + incr > heap_clean)
+	heap_clean = (char *)p + incr;
+    STAT(sbrk_calls++; peak_heap = MAX(peak_heap, mem_heapsize()));
+#if defined(HUGE_PAGES) && defined(MADV_HUGEPAGE)
+    /* the pages are not touched yet, so they can fault in huge */
+    if (p != (void *)-1 && incr > 0) {
+	size_t lo = ((size_t)p + HUGE_PAGE - 1) & ~(size_t)(HUGE_PAGE - 1);
+	size_t hi = ((size_t)p + incr) & ~(size_t)(HUGE_PAGE - 1);
+
+	if (lo < hi)
+	    madvise((void *)lo, hi - lo, MADV_HUGEPAGE);
+    }
+#endif
+    return p;
+}
+
+/* 
+ * align_heap - Pad the break so the first payload is DSIZE aligned
+ */
+#ifdef HUGE_PAGES
+/*
+ * prefault - Fault in the size bytes of heap at lo now, one write per
+ *     page, so the first mallocs do not pay for it
+ */
+static void prefault(char *lo, size_t size)
+{
+    size_t page = mem_pagesize(), i;
+
+    for (i = 0; i < size; i += page)
+	*(volatile char *)(lo + i) = *(volatile char *)(lo + i);
+}
+#endif
+
+static int align_heap(void)
+{
+    size_t brk = (size_t)mem_heap_hi() + 1;
+
+    if ((brk % DSIZE) && heap_sbrk(DSIZE - brk % DSIZE) == (void *)-1)
+	return -1;
+    return 0;
+}
+
+/* 
+ * place - Place block of asize bytes at start of free block bp 
+ *         and split if remainder would be at least minimum block size
+ */
+/* $begin mmplace */
+/* $begin mmplace-proto */
+static void place(void *bp, size_t asize)
+/* $end mmplace-proto */
+{
+    size_t csize = GET_SIZE(HDRP(bp));   
+
+    deleteblock(bp);
+    if ((csize - asize) >= MINBLOCK) { 
+	setblock(bp, asize, 1);
+	bp = NEXT_BLKP(bp);
+	setblock(bp, csize-asize, 0);
+	coalesce(bp); /* the rest of a pending block may border a free one */
+    }
+    else { 
+	setblock(bp, csize, 1);
+    }
+}
+/* $end mmplace */
+
+/* 
+ * realloc_place - Make bp an allocated block spanning total bytes and
+ *     give back whatever lies beyond target bytes as a free block
+ */
+static void realloc_place(void *bp, size_t total, size_t target)
+{
+    if (target + MINBLOCK <= total) {
+	setblock(bp, target, 1);
+	setblock(NEXT_BLKP(bp), total - target, 0);
+	coalesce(NEXT_BLKP(bp));
+    }
+    else {
+	setblock(bp, total, 1);
+    }
+}
+
+/* 
+ * alloc_aligned - Allocate a block whose payload of size bytes starts on
+ *     an align boundary, align being a power of two. A plain fit that
+ *     happens to be aligned is taken as is, otherwise the slack in front
+ *     of an oversized block is split off as a free block, and so is any
+ *     slack behind.
+ */
+static void *alloc_aligned(size_t size, size_t align)
+{
+    char *bp, *abp;
+    size_t total;
+
+    if ((bp = block_malloc(size)) == NULL || (size_t)bp % align == 0)
+	return bp;
+    arena_free(bp);
+    /* in block bytes: the front free block and the aligned block both fit */
+    if ((bp = block_malloc(ASIZE(size) + align + MINBLOCK)) == NULL)
+	return NULL;
+    if ((size_t)bp % align == 0) {
+	abp = bp;
+    } else {
+	/* leave room for a free block in front */
+	abp = (char *)(((size_t)bp + MINBLOCK + (align - 1)) & ~(align - 1));
+	total = GET_SIZE(HDRP(bp));
+	setblock(bp, abp - bp, 0);
+	setblock(abp, total - (abp - bp), 1);
+	coalesce(bp);
+    }
+    assert(GET_SIZE(HDRP(abp)) >= ASIZE(size));
+    realloc_place(abp, GET_SIZE(HDRP(abp)), ASIZE(size));
+    return abp;
+}
+
+/*
+ * zero_dirty - Zero the bytes of new block bp the heap may have written:
+ *     everything below clean, the free list links at the front and the
+ *     free block footer at the back. Mappings come zeroed.
+ */
+static void zero_dirty(char *bp, size_t bytes, char *clean)
+{
+    char *lo, *hi;
+
+#ifdef SLAB
+    if (slab_of(bp) != NULL) {
+	memset(bp, 0, bytes);
+	return;
+    }
+#endif
+#ifdef MMAP_LARGE
+    if (IS_MAPPED(bp))
+	return;
+#endif
+    lo = MAX(clean, bp + 4*PSIZE);
+    hi = MIN(bp + bytes, FTRP(bp));
+    if (lo >= hi) {
+	memset(bp, 0, bytes);
+	return;
+    }
+    memset(bp, 0, lo - bp);
+    memset(hi, 0, bp + bytes - hi);
+}
+
+/* 
+ * find_fit - Find a fit for a block with asize bytes 
+ */
+static void *find_fit(size_t asize)
+{
+#if defined(DEFER_COALESCE) || defined(TREE_FIT)
+    void *bp;
+#endif
+
+#ifdef DEFER_COALESCE
+    /* reuse a recently freed block only if it fits without a split */
+    for (bp = NEXT_BLKP_EX(PEND_HEAD); bp != NULL; bp = NEXT_BLKP_EX(bp)) {
+	STAT(ar->stats.fit_probes++);
+	if (asize <= GET_SIZE(HDRP(bp)) && GET_SIZE(HDRP(bp)) < asize + MINBLOCK) {
+	    return bp;
+	}
+    }
+#endif
+
+#ifdef TREE_FIT
+    /* large requests go straight to best fit, small ones fall back to it */
+    if (asize >= TREE_MINSIZE)
+	return tree_fit(asize);
+    if ((bp = list_fit(asize)) != NULL)
+	return bp;
+    return tree_fit(asize);
+#else
+    return list_fit(asize);
+#endif
+}
+
+/* 
+ * list_fit - Find a fit for a block with asize bytes on the free lists
+ */
+static void *list_fit(size_t asize)
+{
+#ifdef SEG_FIT
+    /* segregated first fit: start at the smallest class that can hold asize */
+    void *bp;
+    int i;
+
+    for (i = sizeclass(asize); i < SEG_CLASSES; i++) {
+	for (bp = NEXT_BLKP_EX(SEG_HEAD(i)); bp != NULL; bp = NEXT_BLKP_EX(bp)) {
+	    STAT(ar->stats.fit_probes++);
+	    if (asize <= GET_SIZE(HDRP(bp))) {
+		return bp;
+	    }
+	}
+    }
+    return NULL; /* no fit */
+#elif defined(NEXT_FIT) 
+    /* next fit search */
+    char *oldrover = ar->rover;
+
+    /* search from the rover to the end of list */
+    for (; ar->rover != NULL; ar->rover = NEXT_BLKP_EX(ar->rover)) {
+	STAT(ar->stats.fit_probes++);
+	if (!GET_ALLOC(ar->rover) && asize <= GET_SIZE(HDRP(ar->rover))){
+	    return ar->rover;
+	}
+    }
+
+    // /* search from start of list to old rover */
+    for (ar->rover = NEXT_BLKP_EX(ar->heap_listp); ar->rover != NULL; ar->rover = NEXT_BLKP_EX(ar->rover)) {
+	STAT(ar->stats.fit_probes++);
+	if (asize <= GET_SIZE(HDRP(ar->rover))) {
+	    return ar->rover;
+	}
+    }
+
+    return NULL;  /* no fit found */
+#else 
+    /* first fit search */
+    void *bp;
+
+    for (bp = NEXT_BLKP_EX(ar->heap_listp); bp != NULL; bp = NEXT_BLKP_EX(bp)) {
+	STAT(ar->stats.fit_probes++);
+	if (asize <= GET_SIZE(HDRP(bp))) {
+	    return bp;
+	}
+    }
+    return NULL; /* no fit */
+#endif
+}
+
+/*
+ * coalesce - boundary tag coalescing. Return ptr to coalesced block
+ */
+static void *coalesce(void *bp) 
+{
+    size_t size = GET_SIZE(HDRP(bp));
+
+    /*
+     * The tags between merged blocks are cleared: after two fresh
+     * extensions join in grow_heap they lie above the heap_clean that
+     * mm_calloc read, where zero_dirty takes memory to be zero.
+     */
+    /* a pending neighbour may border a free block of its own, so keep going */
+    while (!PREV_ALLOCATED(bp)) {
+        void *prv = PREV_BLKP(bp);
+        size += GET_SIZE(HDRP(prv));
+        deleteblock(prv); /* before its size changes */
+        PUT(FTRP(prv), 0);
+        PUT(HDRP(bp), 0);
+        bp = prv;
+        setblock(bp, size, 0);
+    }
+
+    while (!GET_ALLOC(HDRP(NEXT_BLKP(bp)))) {
+        void *nxt = NEXT_BLKP(bp);
+        size += GET_SIZE(HDRP(nxt));
+        deleteblock(nxt);
+        PUT(FTRP(bp), 0);
+        PUT(HDRP(nxt), 0);
+        setblock(bp, size, 0);
+    }
+
+    insertblock(bp);
+
+#ifdef NEXT_FIT
+    /* Make sure the rover isn't pointing into the free block */
+    /* that we just coalesced */
+    if ((ar->rover > (char *)bp) && (ar->rover < NEXT_BLKP(bp))) {
+        ar->rover = bp;
+    }
+#endif
+
+    return bp;
+}
+
+
+static void printblock(void *bp) 
+{
+    size_t hsize, halloc, fsize, falloc;
+
+    hsize = GET_SIZE(HDRP(bp));
+    halloc = GET_ALLOC(HDRP(bp));  
+    fsize = GET_SIZE(FTRP(bp));
+    falloc = GET_ALLOC(FTRP(bp));  
+    
+#ifdef FOOTERLESS
+    if (hsize != 0 && halloc) {
+	printf("%p: header: [%lu:%c:%c]\n", bp, (unsigned long)hsize,
+	       'a', (GET_PREV_ALLOC(HDRP(bp)) ? 'a' : 'f'));
+	return;
+    }
+#endif
+
+    if (hsize == 0) {
+	printf("%p: EOL\n", bp);
+	return;
+    }
+
+    printf("%p: header: [%lu:%c] footer: [%lu:%c]\n", bp, 
+	   (unsigned long)hsize, (halloc ? 'a' : 'f'), 
+	   (unsigned long)fsize, (falloc ? 'a' : 'f')); 
+}
+
+static void checkblock(void *bp) 
+{
+    if ((size_t)bp % DSIZE)
+	printf("Error: %p is not doubleword aligned\n", bp);
+#ifdef THREAD_ARENAS
+    if ((GET(HDRP(bp)) & ~(((word_t)1 << TAG_SHIFT) - 1)) != ARENA_TAG)
+	printf("Error: %p carries another arena's tag\n", bp);
+#endif
+#ifdef FOOTERLESS
+    /* allocated blocks have no footer to compare against */
+    if (GET_ALLOC(HDRP(bp)))
+	return;
+    if ((GET(HDRP(bp)) & ~(PREVALLOC | PENDING)) != GET(FTRP(bp)))
+	printf("Error: header does not match footer\n");
+#else
+    if ((GET(HDRP(bp)) & ~PENDING) != GET(FTRP(bp)))
+	printf("Error: header does not match footer\n");
+#endif
+    if (GET_PENDING(HDRP(bp)) && GET_ALLOC(HDRP(bp)))
+	printf("Error: %p is pending but allocated\n", bp);
+}
+
+/*
+ * setblock - Write the boundary tags of block bp. With FOOTERLESS only
+ *     free blocks get a footer, bp keeps its own previous-allocated bit
+ *     and the next block's bit is updated to match alloc.
+ */
+static void setblock(void *bp, size_t size, int alloc)
+{
+#ifdef FOOTERLESS
+    char *next;
+
+    PUT(HDRP(bp), PACK(size, alloc) | ARENA_TAG | GET_PREV_ALLOC(HDRP(bp)));
+    if (!alloc)
+	PUT(FTRP(bp), PACK(size, alloc) | ARENA_TAG);
+    next = NEXT_BLKP(bp);
+    /* next may be allocated, its tag read by a thread freeing it */
+    if (alloc)
+	PUT_SHARED(HDRP(next), GET(HDRP(next)) | PREVALLOC);
+    else
+	PUT_SHARED(HDRP(next), GET(HDRP(next)) & ~PREVALLOC);
+#else
+    PUT(HDRP(bp), PACK(size, alloc) | ARENA_TAG);
+    PUT(FTRP(bp), PACK(size, alloc) | ARENA_TAG);
+#endif
+#ifdef CHECK_SAMPLE
+    /* a block that swallows the check cursor takes its place */
+    if (ar->check_next > (char *)bp && ar->check_next < (char *)bp + size)
+	ar->check_next = bp;
+#endif
+}
+
+static void insertblock(void *bp) {
+#ifdef DEFER_COALESCE
+    if (GET_PENDING(HDRP(bp))) {
+        void *tmp = NEXT_BLKP_EX(PEND_HEAD);
+        PUT_ADDR(NXTP(bp), tmp);
+        if (tmp != NULL) PUT_ADDR(PRVP(tmp), bp);
+        PUT_ADDR(PRVP(bp), PEND_HEAD);
+        PUT_ADDR(NXTP(PEND_HEAD), bp);
+        ar->pend_count++;
+        return;
+    }
+#endif
+#ifdef TREE_FIT
+    if (GET_SIZE(HDRP(bp)) >= TREE_MINSIZE) {
+        tree_insert(&ar->tree_root, bp);
+        return;
+    }
+#endif
+#ifdef ADDR_ORDER
+    /* link bp in right after the listed block just below it */
+    void *head = addr_pred(bp);
+    int r = REGION(bp);
+    if (ar->region_last[r] == NULL || ar->region_last[r] < (char *)bp)
+        ar->region_last[r] = bp;
+    ar->region_map[r / LBITS] |= 1UL << (r % LBITS);
+#else
+    void *head = list_head(GET_SIZE(HDRP(bp)));
+#endif
+    void *tmp = NEXT_BLKP_EX(head);
+    PUT_ADDR(NXTP(bp), tmp);
+    if (tmp != NULL) PUT_ADDR(PRVP(tmp), bp);
+    PUT_ADDR(PRVP(bp), head);
+    PUT_ADDR(NXTP(head), bp);
+}
+
+static void deleteblock(void *bp) {
+#ifdef DEFER_COALESCE
+    if (GET_PENDING(HDRP(bp)))
+        ar->pend_count--; /* unlinked like any list block below */
+#endif
+#ifdef TREE_FIT
+    if (!GET_PENDING(HDRP(bp)) && GET_SIZE(HDRP(bp)) >= TREE_MINSIZE) {
+        tree_delete(&ar->tree_root, bp);
+        return;
+    }
+#endif
+    #ifdef NEXT_FIT
+        if (ar->rover == bp) ar->rover = NEXT_BLKP_EX(bp);
+    #endif
+    void *nxt = NEXT_BLKP_EX(bp);
+    void *prv = PREV_BLKP_EX(bp);
+#ifdef ADDR_ORDER
+    int r = REGION(bp);
+    if (!GET_PENDING(HDRP(bp)) && ar->region_last[r] == bp) {
+        /* the block below takes over the region, if it is in it */
+        if (prv != ar->heap_listp && REGION(prv) == r) {
+            ar->region_last[r] = prv;
+        } else {
+            ar->region_last[r] = NULL;
+            ar->region_map[r / LBITS] &= ~(1UL << (r % LBITS));
+        }
+    }
+#endif
+    if (nxt != NULL) PUT_ADDR(PRVP(nxt), prv);
+    PUT_ADDR(NXTP(prv), nxt);
+}
+
+#ifndef ADDR_ORDER
+/*
+ * list_head - Return the sentinel of the free list a block of size bytes belongs to
+ */
+static void *list_head(size_t size) {
+#ifdef SEG_FIT
+    return SEG_HEAD(sizeclass(size));
+#else
+    (void)size;
+    return ar->heap_listp;
+#endif
+}
+#endif
+
+#ifdef ADDR_ORDER
+/*
+ * addr_pred - Return the listed block just below bp, or the list
+ *     sentinel. The index names the highest listed block of the nearest
+ *     region at or below bp's, so at most one region's blocks are walked.
+ */
+static void *addr_pred(void *bp) {
+    int q = region_below(REGION(bp));
+    char *p;
+
+    if (q < 0)
+        return ar->heap_listp;
+    for (p = ar->region_last[q]; p != ar->heap_listp && p > (char *)bp; p = PREV_BLKP_EX(p))
+        ;
+    return p;
+}
+
+/*
+ * region_below - Return the highest region at or below r holding a
+ *     listed block, or -1 if there is none
+ */
+static int region_below(int r) {
+    int w = r / LBITS;
+    unsigned long m = ar->region_map[w] & (~0UL >> (LBITS - 1 - r % LBITS));
+
+    while (m == 0) {
+        if (--w < 0)
+            return -1;
+        m = ar->region_map[w];
+    }
+    return w * LBITS + LBITS - 1 - __builtin_clzl(m);
+}
+
+/*
+ * region_grow - Double the heap bytes per index region until the
+ *     arena's heap fits in ADDR_REGIONS of them. Regions 2i and 2i+1
+ *     merge into i, whose last block is the higher of their two.
+ */
+static void region_grow(void) {
+    int r;
+
+    while ((((size_t)ar->heap_end - 1 - addr_base) >> ar->region_shift) >= ADDR_REGIONS) {
+        memset(ar->region_map, 0, sizeof(ar->region_map));
+        for (r = 0; r < ADDR_REGIONS / 2; r++) {
+            char *hi = ar->region_last[2*r + 1];
+            ar->region_last[r] = hi != NULL ? hi : ar->region_last[2*r];
+            if (ar->region_last[r] != NULL)
+                ar->region_map[r / LBITS] |= 1UL << (r % LBITS);
+        }
+        memset(&ar->region_last[ADDR_REGIONS / 2], 0,
+               sizeof(ar->region_last) / 2);
+        ar->region_shift++;
+    }
+}
+
+/*
+ * checkorder - Check that the free list runs in address order and that
+ *     the region index names the last listed block of every region
+ */
+static void checkorder(void) {
+    char *bp, *prev = NULL;
+    int r, regions = 0, marked = 0;
+
+    for (bp = NEXT_BLKP_EX(ar->heap_listp); ; prev = bp, bp = NEXT_BLKP_EX(bp)) {
+        if (prev != NULL && (bp == NULL || REGION(bp) != REGION(prev))) {
+            regions++;
+            if (ar->region_last[REGION(prev)] != prev)
+                printf("Error: region %d index does not name %p\n", REGION(prev), prev);
+        }
+        if (bp == NULL)
+            break;
+        if (prev != NULL && prev >= bp)
+            printf("Error: %p is listed after %p, out of address order\n", bp, prev);
+    }
+    for (r = 0; r < ADDR_REGIONS; r++)
+        if (ar->region_map[r / LBITS] & (1UL << (r % LBITS)))
+            marked++;
+    if (marked != regions)
+        printf("Error: %d regions marked, %d hold listed blocks\n", marked, regions);
+}
+#endif
+
+#ifdef SEG_FIT
+/*
+ * sizeclass - Map a block size to its class. Class 0 holds blocks up to
+ *     MINBLOCK bytes, class i blocks up to MINBLOCK << i, and the last
+ *     class holds everything larger.
+ */
+static int sizeclass(size_t size) {
+    int i = 0;
+    size_t limit = MINBLOCK;
+
+    while ((i < SEG_CLASSES - 1) && (size > limit)) {
+        limit <<= 1;
+        i++;
+    }
+    return i;
+}
+#endif
+
+#ifdef QUICK_LIST
+/*
+ * ql_bin - Return the quick list bin that caches blocks of exactly size
+ *     bytes, or -1 if blocks of that size are not cached
+ */
+static int ql_bin(size_t size)
+{
+    if (size < QL_MINBLOCK || size >= QL_MINBLOCK + QL_BINS * DSIZE)
+	return -1;
+    return (size - QL_MINBLOCK) / DSIZE;
+}
+
+/*
+ * ql_pop - Take a cached block of asize bytes, or NULL if its bin is empty.
+ *     The block is still marked allocated, so nothing else is rewritten.
+ */
+static void *ql_pop(size_t asize)
+{
+    int i = ql_bin(asize);
+    void *bp;
+
+    if (i < 0 || (bp = NEXT_BLKP_QL(QL_HEAD(i))) == NULL)
+	return NULL;
+    PUT_ADDR(QL_HEAD(i), NEXT_BLKP_QL(bp));
+    PUT(QL_COUNT(i), GET(QL_COUNT(i)) - 1);
+    return bp;
+}
+
+/*
+ * ql_push - Cache an allocated block in its bin instead of freeing it.
+ *     A full bin is flushed first. Return 0 if the block is not cacheable.
+ */
+static int ql_push(void *bp)
+{
+    int i = ql_bin(GET_SIZE(HDRP(bp)));
+
+    if (i < 0)
+	return 0;
+    if (GET(QL_COUNT(i)) >= QL_LIMIT)
+	ql_flush(i);
+    PUT_ADDR(bp, NEXT_BLKP_QL(QL_HEAD(i)));
+    PUT_ADDR(QL_HEAD(i), bp);
+    PUT(QL_COUNT(i), GET(QL_COUNT(i)) + 1);
+    return 1;
+}
+
+/*
+ * ql_flush - Really free every block cached in bin i
+ */
+static void ql_flush(int i)
+{
+    char *bp = NEXT_BLKP_QL(QL_HEAD(i));
+    char *next;
+
+    PUT_ADDR(QL_HEAD(i), NULL);
+    PUT(QL_COUNT(i), 0);
+    for (; bp != NULL; bp = next) {
+	next = NEXT_BLKP_QL(bp);
+	setblock(bp, GET_SIZE(HDRP(bp)), 0);
+	coalesce(bp);
+    }
+}
+
+/*
+ * ql_flushall - Flush every bin, return the number of blocks freed
+ */
+static int ql_flushall(void)
+{
+    int i, flushed = 0;
+
+    for (i = 0; i < QL_BINS; i++) {
+	flushed += GET(QL_COUNT(i));
+	if (GET(QL_COUNT(i)) > 0)
+	    ql_flush(i);
+    }
+    return flushed;
+}
+#endif
+
+#ifdef TREE_FIT
+/*
+ * The treap orders large free blocks by (size, address), so every key is
+ * unique, and heap-orders them by a hash of the address, so no priority
+ * has to be stored in the block. Expected depth is O(log n).
+ */
+
+/* tree_prio - Heap priority of treap block bp */
+static unsigned tree_prio(void *bp) {
+    return (unsigned)((size_t)bp >> 3) * 2654435761u;
+}
+
+/* tree_less - Return true if block a sorts before block b */
+static int tree_less(void *a, void *b) {
+    size_t asize = GET_SIZE(HDRP(a));
+    size_t bsize = GET_SIZE(HDRP(b));
+
+    return (asize < bsize) || (asize == bsize && (char *)a < (char *)b);
+}
+
+/* tree_rotate - Lift the left (or right) child of *link into its place */
+static void tree_rotate(void **link, int left) {
+    void *t = *link;
+    void *c;
+
+    if (left) {
+        c = LEFT_BLKP(t);
+        PUT_ADDR(LEFTP(t), RIGHT_BLKP(c));
+        PUT_ADDR(RIGHTP(c), t);
+    } else {
+        c = RIGHT_BLKP(t);
+        PUT_ADDR(RIGHTP(t), LEFT_BLKP(c));
+        PUT_ADDR(LEFTP(c), t);
+    }
+    *link = c;
+}
+
+/*
+ * tree_fit - Best fit: the smallest large free block with at least asize bytes
+ */
+static void *tree_fit(size_t asize) {
+    void *bp = ar->tree_root;
+    void *best = NULL;
+
+    while (bp != NULL) {
+        STAT(ar->stats.fit_probes++);
+        if (GET_SIZE(HDRP(bp)) >= asize) {
+            best = bp;
+            bp = LEFT_BLKP(bp);
+        } else {
+            bp = RIGHT_BLKP(bp);
+        }
+    }
+    return best;
+}
+
+/*
+ * tree_insert - Insert block bp into the subtreap at *link
+ */
+static void tree_insert(void **link, void *bp) {
+    void *t = *link;
+
+    if (t == NULL) {
+        PUT_ADDR(LEFTP(bp), NULL);
+        PUT_ADDR(RIGHTP(bp), NULL);
+        *link = bp;
+    } else if (tree_less(bp, t)) {
+        tree_insert((void **)LEFTP(t), bp);
+        if (tree_prio(LEFT_BLKP(t)) > tree_prio(t))
+            tree_rotate(link, 1);
+    } else {
+        tree_insert((void **)RIGHTP(t), bp);
+        if (tree_prio(RIGHT_BLKP(t)) > tree_prio(t))
+            tree_rotate(link, 0);
+    }
+}
+
+/*
+ * tree_delete - Remove block bp from the subtreap at *link by rotating
+ *     it down until it has at most one child
+ */
+static void tree_delete(void **link, void *bp) {
+    void *t = *link;
+
+    if (t != bp) {
+        tree_delete(tree_less(bp, t) ? (void **)LEFTP(t) : (void **)RIGHTP(t), bp);
+    } else if (LEFT_BLKP(t) == NULL) {
+        *link = RIGHT_BLKP(t);
+    } else if (RIGHT_BLKP(t) == NULL) {
+        *link = LEFT_BLKP(t);
+    } else if (tree_prio(LEFT_BLKP(t)) > tree_prio(RIGHT_BLKP(t))) {
+        tree_rotate(link, 1);
+        tree_delete((void **)RIGHTP(*link), bp);
+    } else {
+        tree_rotate(link, 0);
+        tree_delete((void **)LEFTP(*link), bp);
+    }
+}
+
+/*
+ * checktree - Check the subtreap at bp, whose keys must sort strictly
+ *     between blocks lo and hi (NULL for unbounded). Return its node count.
+ */
+static size_t checktree(void *bp, void *lo, void *hi) {
+    if (bp == NULL)
+        return 0;
+    if (GET_ALLOC(HDRP(bp)) || GET_SIZE(HDRP(bp)) < TREE_MINSIZE)
+        printf("Error: %p in treap is not a large free block\n", bp);
+    if ((lo != NULL && !tree_less(lo, bp)) || (hi != NULL && !tree_less(bp, hi)))
+        printf("Error: %p in treap is out of order\n", bp);
+    if ((LEFT_BLKP(bp) != NULL && tree_prio(LEFT_BLKP(bp)) > tree_prio(bp)) ||
+        (RIGHT_BLKP(bp) != NULL && tree_prio(RIGHT_BLKP(bp)) > tree_prio(bp)))
+        printf("Error: %p in treap violates heap order\n", bp);
+    return 1 + checktree(LEFT_BLKP(bp), lo, bp) + checktree(RIGHT_BLKP(bp), bp, hi);
+}
+#endif
+
+#ifdef DEFER_COALESCE
+/*
+ * pend_flush - Coalesce every pending block in one pass. Coalescing one
+ *     block may swallow pending neighbours, which deleteblock takes off
+ *     the pending list, so the loop always restarts at the list head.
+ */
+static void pend_flush(void) {
+    void *bp;
+
+    while ((bp = NEXT_BLKP_EX(PEND_HEAD)) != NULL) {
+        deleteblock(bp);
+        setblock(bp, GET_SIZE(HDRP(bp)), 0); /* clears the pending bit */
+        bp = coalesce(bp);
+        if (trim_threshold && GET_SIZE(HDRP(NEXT_BLKP(bp))) == 0 &&
+            GET_SIZE(HDRP(bp)) > trim_threshold)
+            trim_heap(bp);
+    }
+}
+#endif
+
+#ifdef REMOTE_FREE
+/*
+ * remote_push - Push block bp on the remote free stack of the current
+ *     arena. Any number of threads may push at once. The block keeps its
+ *     allocated header and only its first payload word is used as a link.
+ */
+static void remote_push(void *bp) {
+    void *head = __atomic_load_n(&ar->remote, __ATOMIC_RELAXED);
+
+    do {
+        PUT_ADDR(bp, head);
+    } while (!__atomic_compare_exchange_n(&ar->remote, &head, bp, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+ * remote_drain - Free every block on the current arena's remote free
+ *     stack. The caller holds the arena lock. The stack is detached with
+ *     one exchange, so the lone consumer never races a pop against a push.
+ */
+static void remote_drain(void) {
+    void *bp, *next;
+
+    if (__atomic_load_n(&ar->remote, __ATOMIC_RELAXED) == NULL)
+        return;
+    for (bp = __atomic_exchange_n(&ar->remote, NULL, __ATOMIC_ACQUIRE); bp != NULL; bp = next) {
+        next = NEXT_BLKP_RF(bp);
+        STAT(ar->stats.frees++; stat_live(-(long)block_bytes(bp)));
+        arena_free(bp);
+    }
+}
+#endif
+
+#ifdef SLAB
+/*
+ * slab_of - Return the run holding slab object p, or NULL if p is the
+ *     payload of an ordinary block. No ordinary payload starts inside a
+ *     run's page, so one bit per page settles it.
+ */
+static struct slab *slab_of(void *p) {
+    size_t page = ((size_t)p - slab_base) / SLAB_RUN;
+
+    if ((size_t)p < slab_base || page >= SLAB_PAGES)
+        return NULL;
+    if (!(__atomic_load_n(&slab_map[page / 8], __ATOMIC_RELAXED) & (1 << (page % 8))))
+        return NULL;
+    return (struct slab *)((size_t)p & ~(size_t)(SLAB_RUN - 1));
+}
+
+/*
+ * slab_alloc - Hand out an object of the smallest class that holds size
+ *     bytes, or NULL if no run can be had
+ */
+static void *slab_alloc(size_t size) {
+    struct slab *run;
+    void *p;
+    int i = 0;
+
+    while ((size_t)(SLAB_MINOBJ << i) < size)
+        i++;
+    if ((run = ar->slab_list[i]) == NULL && (run = slab_new(i)) == NULL)
+        return NULL;
+    p = run->free;
+    run->free = NEXT_OBJ(p);
+    run->used++;
+    if (run->free == NULL) {
+        /* a full run leaves the list until an object comes back */
+        ar->slab_list[i] = run->next;
+        if (run->next != NULL)
+            run->next->prev = NULL;
+    }
+    return p;
+}
+
+/*
+ * slab_free - Return object p to its run. A run that becomes empty goes
+ *     back to the heap unless it is the last one with free objects.
+ */
+static void slab_free(struct slab *run, void *p) {
+    int i = 0;
+    size_t page;
+
+    while ((unsigned)(SLAB_MINOBJ << i) < run->size)
+        i++;
+    if (run->free == NULL) {
+        run->prev = NULL;
+        run->next = ar->slab_list[i];
+        if (run->next != NULL)
+            run->next->prev = run;
+        ar->slab_list[i] = run;
+    }
+    NEXT_OBJ(p) = run->free;
+    run->free = p;
+    if (--run->used > 0 || (run->prev == NULL && run->next == NULL))
+        return;
+
+    if (run->prev != NULL)
+        run->prev->next = run->next;
+    else
+        ar->slab_list[i] = run->next;
+    if (run->next != NULL)
+        run->next->prev = run->prev;
+    page = ((size_t)run - slab_base) / SLAB_RUN;
+    __atomic_fetch_and(&slab_map[page / 8], (unsigned char)~(1 << (page % 8)), __ATOMIC_RELAXED);
+    arena_free(run);
+}
+
+/*
+ * slab_new - Carve a run for class i out of the heap and put it on the
+ *     class list. Objects start at a multiple of their size, past the
+ *     descriptor, so none of them straddles more cache lines than needed.
+ */
+static struct slab *slab_new(int i) {
+    struct slab *run;
+    size_t size = SLAB_MINOBJ << i;
+    size_t page, off;
+
+    if ((run = alloc_aligned(SLAB_BYTES, SLAB_RUN)) == NULL)
+        return NULL;
+    page = ((size_t)run - slab_base) / SLAB_RUN;
+    if (page >= SLAB_PAGES) {
+        arena_free(run); /* beyond the page map, serve the request normally */
+        return NULL;
+    }
+    run->size = size;
+    run->used = 0;
+    run->free = NULL;
+    for (off = SLAB_FIRST(size) + (SLAB_OBJS(size) - 1) * size; off >= SLAB_FIRST(size); off -= size) {
+        NEXT_OBJ((char *)run + off) = run->free;
+        run->free = (char *)run + off;
+    }
+    run->prev = NULL;
+    run->next = ar->slab_list[i];
+    if (run->next != NULL)
+        run->next->prev = run;
+    ar->slab_list[i] = run;
+    __atomic_fetch_or(&slab_map[page / 8], (unsigned char)(1 << (page % 8)), __ATOMIC_RELAXED);
+    return run;
+}
+
+/*
+ * checkslab - Check run of class i, which is on the class list
+ */
+static void checkslab(struct slab *run, int i) {
+    size_t nfree = 0;
+    char *p;
+
+    if (slab_of(run) != run || run->size != (unsigned)(SLAB_MINOBJ << i))
+        printf("Error: %p on slab list %d is not a run of that class\n", (void *)run, i);
+    if (run->free == NULL)
+        printf("Error: full run %p is on slab list %d\n", (void *)run, i);
+    for (p = run->free; p != NULL; p = NEXT_OBJ(p)) {
+        if (slab_of(p) != run || (size_t)(p - (char *)run) % run->size ||
+            (size_t)(p - (char *)run) < SLAB_FIRST(run->size)) {
+            printf("Error: free object %p is not in run %p\n", p, (void *)run);
+            return;
+        }
+        nfree++;
+    }
+    if (nfree + run->used != SLAB_OBJS(run->size))
+        printf("Error: run %p counts %u used and %lu free objects\n", (void *)run,
+               run->used, (unsigned long)nfree);
+}
+#endif
+
+#ifdef STATS
+/*
+ * block_bytes - Return the bytes allocated block or slab object bp takes
+ */
+static size_t block_bytes(void *bp) {
+#ifdef SLAB
+    struct slab *run = slab_of(bp);
+
+    if (run != NULL)
+        return run->size;
+#endif
+#ifdef MMAP_LARGE
+    if (IS_MAPPED(bp))
+        return MAP_LEN(bp);
+#endif
+    return GET_SIZE(HDRP(bp));
+}
+
+/*
+ * stat_live - Add delta bytes to the current arena's live count
+ */
+static void stat_live(long delta) {
+    ar->stats.bytes_live += delta;
+    ar->stats.peak_live = MAX(ar->stats.peak_live, ar->stats.bytes_live);
+}
+#endif
+
+#ifdef RECORD
+/*
+ * rec_open - Start logging if MM_TRACE names a file. The file stays
+ *     open across mm_init calls, which are logged as MM_REC_INIT.
+ */
+static void rec_open(void)
+{
+    const char *path;
+
+    if (rec_fd >= 0 || (path = getenv("MM_TRACE")) == NULL)
+	return;
+    if ((rec_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+	return;
+#ifdef THREAD_ARENAS
+    if (pthread_key_create(&rec_key, rec_close) != 0) {
+	close(rec_fd);
+	rec_fd = -1;
+	return;
+    }
+#endif
+    atexit(rec_exit);
+    rec_on = 1;
+}
+
+/*
+ * rec_log - Append one record to the calling thread's log block. The
+ *     block is mapped straight onto the file, so this is a few stores;
+ *     the kernel writes full blocks back on its own.
+ */
+static void rec_log(int op, size_t size, void *id)
+{
+    struct mm_rec_block *b = rec_blk;
+    uint64_t now = rec_ticks();
+    struct mm_rec *r;
+
+    if (b == NULL || b->count == sizeof(b->recs) / sizeof(b->recs[0]))
+	if ((b = rec_next(now)) == NULL)
+	    return;
+    r = &b->recs[b->count];
+    r->delta = MIN(now - rec_last, UINT32_MAX);
+    r->size = MIN(size, UINT32_MAX);
+    r->id = (uint64_t)(uintptr_t)id | op;
+    b->count++;
+    rec_last = now;
+}
+
+/*
+ * rec_next - Unmap the calling thread's full block, claim the next
+ *     block of the file and map it. Stops recording on any error.
+ */
+static struct mm_rec_block *rec_next(uint64_t now)
+{
+    struct mm_rec_block *b;
+    struct timespec ts;
+    off_t off;
+
+    if (rec_blk != NULL) {
+	munmap(rec_blk, MM_REC_BLOCK);
+	rec_blk = NULL;
+    }
+    LOCK(&rec_lock);
+    off = rec_off;
+    if (off + MM_REC_BLOCK > rec_size) {
+	if (ftruncate(rec_fd, off + (off_t)REC_GROW * MM_REC_BLOCK) < 0) {
+	    UNLOCK(&rec_lock);
+	    rec_on = 0;
+	    return NULL;
+	}
+	rec_size = off + (off_t)REC_GROW * MM_REC_BLOCK;
+    }
+    rec_off = off + MM_REC_BLOCK;
+    UNLOCK(&rec_lock);
+
+    b = mmap(NULL, MM_REC_BLOCK, PROT_READ | PROT_WRITE, MAP_SHARED, rec_fd, off);
+    if (b == MAP_FAILED) {
+	rec_on = 0;
+	return NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    b->count = 0;
+#ifdef THREAD_ARENAS
+    b->thread = (uint64_t)pthread_self();
+    pthread_setspecific(rec_key, b); /* so rec_close runs when the thread exits */
+#else
+    b->thread = 0;
+#endif
+    b->start = now;
+    b->start_ns = (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+    b->magic = MM_REC_MAGIC;
+    rec_last = now;
+    return rec_blk = b;
+}
+
+#ifdef THREAD_ARENAS
+/*
+ * rec_close - Unmap an exiting thread's log block
+ */
+static void rec_close(void *blk)
+{
+    if (blk != NULL)
+	munmap(blk, MM_REC_BLOCK);
+}
+#endif
+
+/*
+ * rec_exit - Unmap the exiting thread's block and cut the file back to
+ *     the blocks claimed so far
+ */
+static void rec_exit(void)
+{
+    rec_on = 0;
+    if (rec_blk != NULL) {
+	munmap(rec_blk, MM_REC_BLOCK);
+	rec_blk = NULL;
+    }
+    LOCK(&rec_lock);
+    if (ftruncate(rec_fd, rec_off) == 0)
+	rec_size = rec_off;
+    UNLOCK(&rec_lock);
+}
+
+/*
+ * rec_ticks - Read the cheapest clock there is
+ */
+static uint64_t rec_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+#endif
@@ -0,0 +1,16 @@
+/*
+ * mm_alloc.h - Allocation entry points of malloc_explicit.c beyond the
+ *              ones mm.h declares
+ */
+#ifndef MM_ALLOC_H
+#define MM_ALLOC_H
+
+#include <stddef.h>
+
+/* Allocate nmemb * size zeroed bytes, or NULL if the product overflows */
+void *mm_calloc(size_t nmemb, size_t size);
+
+/* Allocate size bytes starting on an align boundary, align a power of two */
+void *mm_memalign(size_t align, size_t size);
+
+#endif /* MM_ALLOC_H */
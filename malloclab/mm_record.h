@@ -0,0 +1,43 @@
+/*
+ * mm_record.h - Allocation log written by malloc_explicit.c when it is
+ *               built with RECORD defined and MM_TRACE names a file
+ *
+ * The log is a sequence of MM_REC_BLOCK byte blocks. Each block belongs
+ * to one thread and holds that thread's next count records; a block is
+ * valid up to count at any time, even while its thread is still writing.
+ */
+#ifndef MM_RECORD_H
+#define MM_RECORD_H
+
+#include <stdint.h>
+
+#define MM_REC_MAGIC  0x6d6d7263u /* "mmrc", first word of every block */
+#define MM_REC_BLOCK  (1<<16)     /* bytes per log block */
+
+/* Record ops, kept in the low bits of the id */
+#define MM_REC_OPMASK  0x7
+#define MM_REC_INIT    1  /* mm_init, the heap starts over */
+#define MM_REC_MALLOC  2  /* mm_malloc(size) returned id */
+#define MM_REC_FREE    3  /* mm_free(id) */
+#define MM_REC_REALLOC 4  /* mm_realloc(id, size), the next record gives the result */
+#define MM_REC_RESULT  5  /* id returned by the mm_realloc just before */
+
+struct mm_rec {
+    uint32_t delta;   /* clock ticks since the thread's previous record, saturating */
+    uint32_t size;    /* requested bytes, saturating */
+    uint64_t id;      /* block address | op */
+};
+
+struct mm_rec_block {
+    uint32_t magic;   /* MM_REC_MAGIC */
+    uint32_t count;   /* records written so far */
+    uint64_t thread;  /* id of the writing thread */
+    uint64_t start;   /* clock ticks the first delta counts from */
+    uint64_t start_ns; /* CLOCK_MONOTONIC time of start, to calibrate ticks */
+    struct mm_rec recs[(MM_REC_BLOCK - 32) / sizeof(struct mm_rec)];
+};
+
+/* Pause (0) or resume (1) recording; a no-op unless MM_TRACE was set */
+void mm_record(int on);
+
+#endif /* MM_RECORD_H */
@@ -0,0 +1,28 @@
+/*
+ * mm_stats.h - Allocator counters, kept by malloc_explicit.c when it is
+ *              built with STATS defined
+ */
+#ifndef MM_STATS_H
+#define MM_STATS_H
+
+#include <stddef.h>
+
+#define MM_STATS_CLASSES 20 /* free block counts reported, power-of-two classes */
+
+struct mm_stats {
+    unsigned long mallocs;      /* mm_malloc calls */
+    unsigned long frees;        /* mm_free calls */
+    unsigned long reallocs;     /* mm_realloc calls */
+    unsigned long fit_probes;   /* free blocks looked at while searching for a fit */
+    unsigned long sbrk_calls;   /* mem_sbrk calls, including failed ones */
+    size_t bytes_live;          /* bytes in allocated blocks and slab objects */
+    size_t peak_live;           /* largest bytes_live seen (summed over arenas) */
+    size_t heap_bytes;          /* current heap size */
+    size_t peak_heap;           /* largest heap size seen */
+    unsigned long free_blocks[MM_STATS_CLASSES]; /* free blocks per size class */
+};
+
+/* Fill out with a snapshot of the counters; free_blocks is counted now */
+void mm_stats(struct mm_stats *out);
+
+#endif /* MM_STATS_H */
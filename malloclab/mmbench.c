@@ -0,0 +1,596 @@
+/*
+ * mmbench - Replay allocation traces against an mm_* allocator and
+ *           report throughput, per-call latency percentiles and
+ *           utilization, plus cache misses where perf events work.
+ *
+ * Build it against the allocator under test and the lab's memlib:
+ *
+ *     gcc -O2 -o mmbench mmbench.c malloc_explicit.c memlib.c
+ *
+ * Traces use the mdriver format: four header lines (suggested heap
+ * size, number of ids, number of ops, weight) followed by one op per
+ * line, "a id size", "r id size" or "f id". A file written by the
+ * allocator's RECORD mode (see mm_record.h) is read as a trace too: its
+ * records from all threads are merged in clock order and block
+ * addresses are mapped back to ids.
+ *
+ * The cost of the two clock reads around each call is measured at
+ * startup, printed, and taken off every latency and the throughput.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include "mm.h"
+#include "memlib.h"
+#include "mm_record.h"
+
+/* Histogram: exact below 2^(SUB_BITS+1) ns, then 2^SUB_BITS buckets per octave */
+#define SUB_BITS    5
+#define SUB_COUNT   (1 << SUB_BITS)
+#define NBUCKETS    (2 * SUB_COUNT + 40 * SUB_COUNT)
+
+/* Bytes of each new block written, as a program filling in a header would */
+#define TOUCH_BYTES 64
+#define MIN_TOUCH(size) ((size) < TOUCH_BYTES ? (size) : TOUCH_BYTES)
+
+/* Op kinds, also the histogram index */
+#define OP_ALLOC    0
+#define OP_REALLOC  1
+#define OP_FREE     2
+#define OP_KINDS    3
+
+typedef struct {
+    int type;                   /* OP_ALLOC, OP_REALLOC or OP_FREE */
+    int index;                  /* block id */
+    size_t size;                /* payload bytes for alloc and realloc */
+} traceop_t;
+
+typedef struct {
+    int num_ids;                /* distinct block ids */
+    int num_ops;                /* ops in the trace */
+    traceop_t *ops;
+} trace_t;
+
+typedef struct {
+    uint64_t ticks;             /* clock at the call */
+    long seq;                   /* position in the file, breaks ties */
+    uint64_t thread;            /* writing thread */
+    int op;                     /* MM_REC_* */
+    size_t size;
+    uint64_t addr;              /* block, or old block for a realloc */
+    uint64_t result;            /* block a realloc returned */
+} logrec_t;
+
+typedef struct {
+    unsigned long count[NBUCKETS];
+    unsigned long total;        /* samples */
+    uint64_t max;               /* largest sample (ns) */
+} hist_t;
+
+static const char *op_names[OP_KINDS] = { "malloc", "realloc", "free" };
+
+int verbose = 0;                /* if true, print per-op histograms */
+static uint64_t clock_ns;       /* cost of an empty timed interval */
+
+static trace_t *read_trace(const char *file);
+static trace_t *read_log(const char *file, FILE *fp);
+static int logrec_cmp(const void *a, const void *b);
+static int *addr_slot(uint64_t *keys, int *vals, size_t mask, uint64_t addr);
+static void free_trace(trace_t *trace);
+static void run_trace(const char *file, trace_t *trace, int reps);
+static void hist_add(hist_t *h, uint64_t ns);
+static uint64_t hist_pct(const hist_t *h, double pct);
+static uint64_t now_ns(void);
+static uint64_t clock_cost(void);
+static int perf_open(void);
+static uint64_t perf_read(int fd);
+void usage(void);
+void unix_error(char *msg);
+void app_error(char *msg);
+
+/*
+ * main - Replay every trace named on the command line
+ */
+int main(int argc, char **argv)
+{
+    int c, i, reps = 1;
+    trace_t *trace;
+
+    while ((c = getopt(argc, argv, "hvr:")) != EOF) {
+	switch (c) {
+	case 'h':             /* print help message */
+	    usage();
+	    break;
+	case 'v':             /* print per-op breakdown */
+	    verbose = 1;
+	    break;
+	case 'r':             /* replay each trace this many times */
+	    reps = atoi(optarg);
+	    break;
+	default:
+	    usage();
+	}
+    }
+    if (optind >= argc || reps < 1)
+	usage();
+
+    mem_init();
+    clock_ns = clock_cost();
+    printf("clock overhead %lu ns per call, subtracted from every latency\n",
+	   (unsigned long)clock_ns);
+    printf("%-24s %9s %8s %6s %7s %7s %7s %9s\n", "trace", "ops", "Mops/s",
+	   "util", "p50ns", "p99ns", "p99.9ns", "miss/op");
+    for (i = optind; i < argc; i++) {
+	if ((trace = read_trace(argv[i])) == NULL)
+	    continue;
+	run_trace(argv[i], trace, reps);
+	free_trace(trace);
+    }
+    return 0;
+}
+
+/*
+ * read_trace - Parse an mdriver trace file, or return NULL on error
+ */
+static trace_t *read_trace(const char *file)
+{
+    FILE *fp;
+    trace_t *trace;
+    char type[2];
+    int weight, i;
+    unsigned index;
+    unsigned long size, heap;
+    uint32_t magic;
+
+    if ((fp = fopen(file, "r")) == NULL) {
+	fprintf(stderr, "%s: cannot open trace\n", file);
+	return NULL;
+    }
+    if (fread(&magic, sizeof(magic), 1, fp) == 1 && magic == MM_REC_MAGIC) {
+	rewind(fp);
+	trace = read_log(file, fp);
+	fclose(fp);
+	return trace;
+    }
+    rewind(fp);
+    if ((trace = malloc(sizeof(trace_t))) == NULL)
+	unix_error("malloc error");
+    if (fscanf(fp, "%lu %d %d %d", &heap, &trace->num_ids, &trace->num_ops, &weight) != 4 ||
+	trace->num_ids < 0 || trace->num_ops < 0) {
+	fprintf(stderr, "%s: bad trace header\n", file);
+	fclose(fp);
+	free(trace);
+	return NULL;
+    }
+    if ((trace->ops = calloc(trace->num_ops, sizeof(traceop_t))) == NULL)
+	unix_error("calloc error");
+
+    for (i = 0; i < trace->num_ops && fscanf(fp, "%1s", type) == 1; i++) {
+	size = 0;
+	if ((type[0] == 'a' || type[0] == 'r') && fscanf(fp, "%u %lu", &index, &size) == 2)
+	    trace->ops[i].type = (type[0] == 'a') ? OP_ALLOC : OP_REALLOC;
+	else if (type[0] == 'f' && fscanf(fp, "%u", &index) == 1)
+	    trace->ops[i].type = OP_FREE;
+	else
+	    break;
+	if (index >= (unsigned)trace->num_ids)
+	    break;
+	trace->ops[i].index = index;
+	trace->ops[i].size = size;
+    }
+    fclose(fp);
+    if (i != trace->num_ops) {
+	fprintf(stderr, "%s: bad op %d\n", file, i);
+	free_trace(trace);
+	return NULL;
+    }
+    return trace;
+}
+
+/*
+ * read_log - Turn an allocation log into a trace. Records are sorted by
+ *     clock, so the merge is only as good as the clocks threads read;
+ *     blocks live before the last MM_REC_INIT are forgotten by it.
+ */
+static trace_t *read_log(const char *file, FILE *fp)
+{
+    struct mm_rec_block *b;
+    logrec_t *recs = NULL, *lr;
+    size_t nrecs = 0, maxrecs = 0, pend[256], mask, i;
+    uint64_t *keys, ticks;
+    int *vals, *slot, npend = 0, j, op;
+    unsigned k;
+    trace_t *trace;
+    traceop_t *t;
+
+    if ((b = malloc(sizeof(*b))) == NULL)
+	unix_error("malloc error");
+    while (fread(b, MM_REC_BLOCK, 1, fp) == 1) {
+	if (b->magic != MM_REC_MAGIC)
+	    continue;                 /* claimed but never written */
+	ticks = b->start;
+	for (k = 0; k < b->count && k < sizeof(b->recs) / sizeof(b->recs[0]); k++) {
+	    ticks += b->recs[k].delta;
+	    op = b->recs[k].id & MM_REC_OPMASK;
+	    if (op == MM_REC_RESULT) {
+		/* attach the result to the thread's pending realloc */
+		for (j = 0; j < npend && recs[pend[j]].thread != b->thread; j++)
+		    ;
+		if (j < npend) {
+		    recs[pend[j]].result = b->recs[k].id & ~(uint64_t)MM_REC_OPMASK;
+		    pend[j] = pend[--npend];
+		}
+		continue;
+	    }
+	    if (nrecs == maxrecs) {
+		maxrecs = maxrecs ? 2 * maxrecs : 4096;
+		if ((recs = realloc(recs, maxrecs * sizeof(logrec_t))) == NULL)
+		    unix_error("realloc error");
+	    }
+	    lr = &recs[nrecs];
+	    lr->ticks = ticks;
+	    lr->seq = (long)nrecs;
+	    lr->thread = b->thread;
+	    lr->op = op;
+	    lr->size = b->recs[k].size;
+	    lr->addr = b->recs[k].id & ~(uint64_t)MM_REC_OPMASK;
+	    lr->result = 0;
+	    if (op == MM_REC_REALLOC && npend < 256)
+		pend[npend++] = nrecs;
+	    nrecs++;
+	}
+    }
+    free(b);
+    qsort(recs, nrecs, sizeof(logrec_t), logrec_cmp);
+
+    /* map addresses to ids: open addressing, a freed address keeps its slot */
+    for (mask = 1; mask < 4 * nrecs; mask <<= 1)
+	;
+    if ((keys = calloc(mask, sizeof(uint64_t))) == NULL ||
+	(vals = calloc(mask, sizeof(int))) == NULL ||
+	(trace = malloc(sizeof(trace_t))) == NULL ||
+	(trace->ops = calloc(nrecs + 1, sizeof(traceop_t))) == NULL)
+	unix_error("calloc error");
+    mask--;
+    trace->num_ids = trace->num_ops = 0;
+    for (i = 0; i < nrecs; i++) {
+	lr = &recs[i];
+	t = &trace->ops[trace->num_ops];
+	switch (lr->op) {
+	case MM_REC_INIT:
+	    memset(keys, 0, (mask + 1) * sizeof(uint64_t));
+	    break;
+	case MM_REC_MALLOC:
+	    if (lr->addr == 0)
+		break;
+	    t->type = OP_ALLOC;
+	    t->index = *addr_slot(keys, vals, mask, lr->addr) = ++trace->num_ids;
+	    t->size = lr->size;
+	    trace->num_ops++;
+	    break;
+	case MM_REC_FREE:
+	    slot = addr_slot(keys, vals, mask, lr->addr);
+	    if (*slot == 0)
+		break;                /* allocated before the log started */
+	    t->type = OP_FREE;
+	    t->index = *slot;
+	    *slot = 0;
+	    trace->num_ops++;
+	    break;
+	case MM_REC_REALLOC:
+	    if (lr->result == 0 && lr->size > 0)
+		break;                /* failed, the block stays */
+	    slot = addr_slot(keys, vals, mask, lr->addr);
+	    if (*slot == 0)
+		*slot = ++trace->num_ids; /* allocated before the log started */
+	    t->type = OP_REALLOC;
+	    t->index = *slot;
+	    t->size = lr->size;
+	    *slot = 0;
+	    if (lr->result != 0)
+		*addr_slot(keys, vals, mask, lr->result) = t->index;
+	    trace->num_ops++;
+	    break;
+	}
+    }
+    trace->num_ids++;                 /* ids start at 1, 0 means unmapped */
+    free(keys);
+    free(vals);
+    free(recs);
+    if (trace->num_ops == 0) {
+	fprintf(stderr, "%s: no calls in log\n", file);
+	free_trace(trace);
+	return NULL;
+    }
+    return trace;
+}
+
+static int logrec_cmp(const void *a, const void *b)
+{
+    const logrec_t *x = a, *y = b;
+
+    if (x->ticks != y->ticks)
+	return x->ticks < y->ticks ? -1 : 1;
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+/*
+ * addr_slot - Return the id slot for addr, claiming one if addr is new
+ */
+static int *addr_slot(uint64_t *keys, int *vals, size_t mask, uint64_t addr)
+{
+    size_t i = (size_t)((addr >> 4) * 0x9e3779b97f4a7c15ull) & mask;
+
+    while (keys[i] != 0 && keys[i] != addr)
+	i = (i + 1) & mask;
+    if (keys[i] == 0) {
+	keys[i] = addr;
+	vals[i] = 0;
+    }
+    return &vals[i];
+}
+
+static void free_trace(trace_t *trace)
+{
+    free(trace->ops);
+    free(trace);
+}
+
+/*
+ * run_trace - Replay trace reps times on a fresh heap and print one
+ *     summary line. Every call is timed on its own, less clock_ns for
+ *     the clock reads around it; throughput is the summed call time, so
+ *     the replay loop itself is not counted.
+ */
+static void run_trace(const char *file, trace_t *trace, int reps)
+{
+    hist_t *hist, all;
+    char **blocks;
+    size_t *sizes;
+    size_t live, peak_live = 0, peak_heap = 0;
+    uint64_t t0, t1, ns, busy = 0, misses = 0;
+    int fd = perf_open();
+    int r, i, k;
+    traceop_t *op;
+    void *p;
+
+    if ((hist = calloc(OP_KINDS, sizeof(hist_t))) == NULL ||
+	(blocks = calloc(trace->num_ids, sizeof(char *))) == NULL ||
+	(sizes = calloc(trace->num_ids, sizeof(size_t))) == NULL)
+	unix_error("calloc error");
+
+    for (r = 0; r < reps; r++) {
+	mem_reset_brk();
+	if (mm_init() < 0)
+	    app_error("mm_init failed");
+	memset(blocks, 0, trace->num_ids * sizeof(char *));
+	live = 0;
+#ifdef __linux__
+	if (fd >= 0) {
+	    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+	    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+#endif
+	for (i = 0; i < trace->num_ops; i++) {
+	    op = &trace->ops[i];
+	    t0 = now_ns();
+	    switch (op->type) {
+	    case OP_ALLOC:
+		p = mm_malloc(op->size);
+		break;
+	    case OP_REALLOC:
+		p = mm_realloc(blocks[op->index], op->size);
+		break;
+	    default:
+		mm_free(blocks[op->index]);
+		p = NULL;
+		break;
+	    }
+	    t1 = now_ns();
+	    ns = t1 - t0 > clock_ns ? t1 - t0 - clock_ns : 0;
+	    busy += ns;
+	    hist_add(&hist[op->type], ns);
+
+	    if (op->type != OP_FREE && p == NULL && op->size > 0) {
+		fprintf(stderr, "%s: op %d: %s(%lu) failed\n", file, i,
+			op_names[op->type], (unsigned long)op->size);
+		goto done;
+	    }
+	    if (op->type == OP_ALLOC)
+		memset(p, (int)i, MIN_TOUCH(op->size));
+	    live -= sizes[op->index];
+	    sizes[op->index] = (op->type == OP_FREE) ? 0 : op->size;
+	    live += sizes[op->index];
+	    blocks[op->index] = p;
+	    if (live > peak_live)
+		peak_live = live;
+	    if (mem_heapsize() > peak_heap)
+		peak_heap = mem_heapsize();
+	}
+#ifdef __linux__
+	if (fd >= 0) {
+	    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+	    misses += perf_read(fd);
+	}
+#endif
+    }
+
+    memset(&all, 0, sizeof(all));
+    for (k = 0; k < OP_KINDS; k++) {
+	for (i = 0; i < NBUCKETS; i++)
+	    all.count[i] += hist[k].count[i];
+	all.total += hist[k].total;
+	if (hist[k].max > all.max)
+	    all.max = hist[k].max;
+    }
+    printf("%-24s %9lu %8.2f %6.3f %7lu %7lu %7lu ", file, all.total,
+	   busy ? all.total * 1e3 / busy : 0.0,
+	   peak_heap ? (double)peak_live / peak_heap : 0.0,
+	   (unsigned long)hist_pct(&all, 50), (unsigned long)hist_pct(&all, 99),
+	   (unsigned long)hist_pct(&all, 99.9));
+    if (fd >= 0)
+	printf("%9.2f\n", all.total ? (double)misses / all.total : 0.0);
+    else
+	printf("%9s\n", "-");
+
+    if (verbose) {
+	for (k = 0; k < OP_KINDS; k++)
+	    if (hist[k].total > 0)
+		printf("  %-8s %9lu calls  p50 %lu  p99 %lu  p99.9 %lu  max %lu ns\n",
+		       op_names[k], hist[k].total,
+		       (unsigned long)hist_pct(&hist[k], 50), (unsigned long)hist_pct(&hist[k], 99),
+		       (unsigned long)hist_pct(&hist[k], 99.9), (unsigned long)hist[k].max);
+	printf("  peak live %lu bytes, peak heap %lu bytes\n",
+	       (unsigned long)peak_live, (unsigned long)peak_heap);
+    }
+
+ done:
+    if (fd >= 0)
+	close(fd);
+    free(hist);
+    free(blocks);
+    free(sizes);
+}
+
+/*
+ * hist_add - Count one sample of ns nanoseconds
+ */
+static void hist_add(hist_t *h, uint64_t ns)
+{
+    int e, i;
+
+    if (ns < 2 * SUB_COUNT) {
+	i = (int)ns;
+    } else {
+	e = 63 - __builtin_clzll(ns);                 /* ns is in [2^e, 2^(e+1)) */
+	i = 2 * SUB_COUNT + (e - SUB_BITS - 1) * SUB_COUNT +
+	    (int)((ns >> (e - SUB_BITS)) - SUB_COUNT);
+	if (i >= NBUCKETS)
+	    i = NBUCKETS - 1;
+    }
+    h->count[i]++;
+    h->total++;
+    if (ns > h->max)
+	h->max = ns;
+}
+
+/*
+ * hist_pct - Return the lower bound of the bucket holding the pct-th
+ *     percentile sample
+ */
+static uint64_t hist_pct(const hist_t *h, double pct)
+{
+    unsigned long want = (unsigned long)(h->total * pct / 100.0);
+    unsigned long seen = 0;
+    int i, e;
+
+    for (i = 0; i < NBUCKETS; i++) {
+	seen += h->count[i];
+	if (seen > want)
+	    break;
+    }
+    if (i >= NBUCKETS)
+	return h->max;
+    if (i < 2 * SUB_COUNT)
+	return i;
+    e = (i - 2 * SUB_COUNT) / SUB_COUNT + SUB_BITS + 1;
+    return (uint64_t)(SUB_COUNT + (i - 2 * SUB_COUNT) % SUB_COUNT) << (e - SUB_BITS);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/*
+ * clock_cost - Return the median length of an empty now_ns interval,
+ *     what timing a call adds to it
+ */
+static uint64_t clock_cost(void)
+{
+    hist_t *h;
+    uint64_t t0, ns;
+    int i;
+
+    if ((h = calloc(1, sizeof(hist_t))) == NULL)
+	unix_error("calloc error");
+    for (i = 0; i < 100000; i++) {
+	t0 = now_ns();
+	hist_add(h, now_ns() - t0);
+    }
+    ns = hist_pct(h, 50);
+    free(h);
+    return ns;
+}
+
+/*
+ * perf_open - Open a disabled user-space cache miss counter for this
+ *     thread, or return -1 where perf events are not available
+ */
+static int perf_open(void)
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static uint64_t perf_read(int fd)
+{
+    uint64_t count = 0;
+
+    if (read(fd, &count, sizeof(count)) != sizeof(count))
+	return 0;
+    return count;
+}
+
+/*
+ * usage - print a help message
+ */
+void usage(void)
+{
+    printf("Usage: mmbench [-hv] [-r reps] trace...\n");
+    printf("   -h        print this message\n");
+    printf("   -v        print per-op latency and heap figures\n");
+    printf("   -r reps   replay each trace reps times\n");
+    exit(1);
+}
+
+/*
+ * unix_error - unix-style error routine
+ */
+void unix_error(char *msg)
+{
+    perror(msg);
+    exit(1);
+}
+
+/*
+ * app_error - application-style error routine
+ */
+void app_error(char *msg)
+{
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
@@ -0,0 +1,94 @@
+/*
+ * mmcalloc - Check that mm_calloc returns zeroed memory when the heap
+ *            has to grow for it, the case where zero_dirty trusts
+ *            heap_clean.
+ *
+ * Build it against the allocator under test and the lab's memlib:
+ *
+ *     gcc -O2 -pthread -o mmcalloc mmcalloc.c malloc_explicit.c memlib.c
+ *
+ * Each round another thread moves the break past the main thread's
+ * heap, then the main thread callocs more than its trailing free block
+ * holds. With THREAD_ARENAS that makes grow_heap open a new chunk that
+ * is still too small and extend it a second time, joining the two
+ * fresh extensions. Every block is filled before it is freed, so
+ * anything calloc fails to clear shows up.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "mm.h"
+#include "memlib.h"
+#include "mm_alloc.h"
+
+#define ROUNDS  64
+#define PAGE    4096
+
+static void *other(void *arg);
+void app_error(char *msg);
+
+/*
+ * main - Run the rounds; exit status 1 on the first nonzero byte
+ */
+int main(void)
+{
+    unsigned char *small, *p;
+    pthread_t tid;
+    size_t size, i;
+    int r;
+
+    mem_init();
+    if (mm_init() < 0)
+	app_error("mm_init failed");
+    for (r = 0; r < ROUNDS; r++) {
+	/* leave a trailing free block in this thread's arena */
+	if ((small = mm_malloc(64)) == NULL)
+	    app_error("mm_malloc failed");
+	if (pthread_create(&tid, NULL, other, NULL) != 0)
+	    app_error("pthread_create failed");
+	pthread_join(tid, NULL);
+
+	size = (2 + r % 16) * PAGE + 8 * r;
+	if ((p = mm_calloc(1, size)) == NULL)
+	    app_error("mm_calloc failed");
+	for (i = 0; i < size; i++) {
+	    if (p[i] != 0) {
+		printf("round %d: calloc(%lu) byte %lu is 0x%02x\n", r,
+		       (unsigned long)size, (unsigned long)i, p[i]);
+		return 1;
+	    }
+	}
+	memset(p, 0xff, size);
+	memset(small, 0xff, 64);
+	if (r % 2)
+	    mm_free(p);
+	mm_free(small);
+    }
+    mm_checkheap(0);
+    printf("%d rounds, calloc memory all zero\n", ROUNDS);
+    return 0;
+}
+
+/*
+ * other - Grow the heap from a thread with an arena of its own
+ */
+static void *other(void *arg)
+{
+    unsigned char *p;
+
+    (void)arg;
+    if ((p = mm_malloc(PAGE)) == NULL)
+	app_error("mm_malloc failed");
+    memset(p, 0xee, PAGE);
+    return NULL;
+}
+
+/*
+ * app_error - application-style error routine
+ */
+void app_error(char *msg)
+{
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
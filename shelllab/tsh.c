@@ -3,6 +3,7 @@
  * 
  * <Minseo Kim / 2022019734>
  */
+#define _GNU_SOURCE         /* pipe2, splice, tee */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -11,13 +12,26 @@
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <time.h>
+#include <poll.h>
+#include <stdatomic.h>
 #include <errno.h>
+#include <spawn.h>
 
 /* Misc manifest constants */
 #define MAXLINE    1024   /* max line size */
 #define MAXARGS     128   /* max args on a command line */
-#define MAXJOBS      16   /* max jobs at any point in time */
-#define MAXJID    1<<16   /* max job ID */
+#define MINJOBS      16   /* jobs the job list starts with room for */
+#define MAXPIPE      16   /* max processes in a pipeline */
+#define SPLICECHUNK (1<<16) /* max bytes the splice builtin moves at once */
+#define RINGSIZE   1024   /* child events sigchld_handler can queue (power of 2) */
+#define INBUF   (1<<16)   /* bytes of input read at once */
+#define MAXJID  (1<<16)   /* max job ID, and so max jobs at any point in time */
+#define HASHSIZE    256   /* command hash buckets (power of 2) */
 
 /* Job states */
 #define UNDEF 0 /* undefined */
@@ -39,16 +53,93 @@
 extern char **environ;      /* defined in libc */
 char prompt[] = "tsh> ";    /* command line prompt (DO NOT CHANGE) */
 int verbose = 0;            /* if true, print additional output */
-int nextjid = 1;            /* next job ID to allocate */
 char sbuf[MAXLINE];         /* for composing sprintf messages */
+char pipetok[] = "|";       /* argv entry of an unquoted | */
 
 struct job_t {              /* The job struct */
-    pid_t pid;              /* job PID */
+    pid_t pid;              /* job PID, also its process group */
     int jid;                /* job ID [1, 2, ...] */
     int state;              /* UNDEF, BG, FG, or ST */
+    int nprocs;             /* processes in the pipeline */
+    int live;               /* of those, how many are not reaped yet */
+    pid_t pids[MAXPIPE];    /* PID of each process, 0 once reaped */
+    int status;             /* wait status of the last process */
     char cmdline[MAXLINE];  /* command line */
+    int run;                /* index in runs if the parallel builtin started it, else -1 */
+    int timed;              /* true if started by the time builtin */
+    struct timespec start;  /* when it was started */
+    struct timeval utime;   /* user time of its processes reaped so far */
+    struct timeval stime;   /* system time of the same */
+    struct job_t *next;     /* next unused job, while on the free list */
 };
-struct job_t jobs[MAXJOBS]; /* The job list */
+
+struct pident_t {           /* A slot of the PID table */
+    pid_t pid;              /* process, 0 if the slot is empty */
+    struct job_t *job;      /* the job it belongs to */
+};
+
+/* 
+ * The job list. Jobs are allocated in blocks that never move and are
+ * found through two indexes: byjid by job ID, and bypid, a linear-probe
+ * hash table, by the PID of any process not reaped yet
+ */
+struct joblist_t {
+    struct job_t **byjid;   /* job of each JID, NULL if the JID is unused */
+    int size;               /* entries in byjid */
+    int maxjid;             /* largest JID in use */
+    struct pident_t *bypid; /* PID -> job */
+    int pidsize;            /* slots in bypid (power of 2) */
+    int npids;              /* slots in bypid in use */
+    struct job_t *free;     /* unused jobs */
+    struct job_t *fg;       /* the job in the FG state, if any */
+};
+struct joblist_t joblist;
+struct joblist_t *jobs = &joblist; /* The job list */
+
+struct run_t {              /* A command line of the parallel builtin */
+    char *cmdline;          /* command line, newline terminated */
+    pid_t pid;              /* job PID once started, else 0 */
+    int done;               /* true once the job has been reaped */
+    int status;             /* how it ended, the job's wait status */
+    struct timespec start;  /* when it was started */
+    struct timespec end;    /* when it was reaped */
+};
+struct run_t *runs;         /* command lines of the running parallel builtin */
+int nruns;                  /* entries in runs */
+volatile sig_atomic_t nrunning; /* of those, started and not reaped yet */
+volatile sig_atomic_t runabort; /* set by ctrl-c: start no more of them */
+
+/* 
+ * Child state changes. sigchld_handler only reaps into a ring and
+ * writes a byte to chldpipe; updatejobs, outside signal context,
+ * applies them to the job list and prints the messages
+ */
+struct chld_t {             /* A child state change */
+    pid_t pid;              /* the child */
+    int status;             /* its wait status */
+    struct timespec when;   /* when it was reaped */
+    struct rusage ru;       /* its resource usage, from wait4 */
+};
+struct chld_t ring[RINGSIZE];   /* written by sigchld_handler only */
+volatile sig_atomic_t ringhead; /* next slot sigchld_handler fills */
+volatile sig_atomic_t ringtail; /* next slot updatejobs takes */
+volatile sig_atomic_t ringfull; /* the ring filled up with children left to reap */
+int chldpipe[2];            /* self-pipe, readable after sigchld_handler ran */
+
+int infd = STDIN_FILENO;    /* where command lines come from */
+char inbuf[INBUF];          /* input read but not yet returned by readcmd */
+size_t inpos, inlen;        /* the unread part is inbuf[inpos..inlen) */
+
+struct hash_t {             /* A command found on PATH */
+    char *name;             /* command name as typed */
+    char *path;             /* where PATH search found it */
+    char *dir;              /* the PATH directory it is in */
+    struct timespec mtime;  /* mtime of dir when it was found */
+    int hits;               /* times it has been run */
+    struct hash_t *next;    /* next command in the bucket */
+};
+struct hash_t *cmdhash[HASHSIZE]; /* The command hash table */
+char *hashpath;             /* PATH the hash table was filled from */
 /* End global variables */
 
 
@@ -56,9 +147,29 @@ struct job_t jobs[MAXJOBS]; /* The job list */
 
 /* Here are the functions that you will implement */
 void eval(char *cmdline);
+int readcmd(char *line);
+void printtime(struct timespec *start, struct timespec *end,
+               struct timeval *utime, struct timeval *stime);
+void shelltimes(struct timeval *utime, struct timeval *stime);
 int builtin_cmd(char **argv);
 void do_bgfg(char **argv);
+void do_hash(char **argv);
+void do_parallel(char **argv);
 void waitfg(pid_t pid);
+void waitchld(void);
+void updatejobs(void);
+struct job_t *runjob(char ***stages, int nstages, int state, char *cmdline,
+                     sigset_t *mask);
+int splitpipe(char **argv, char ***stages);
+int launch(char **argv, pid_t pgid, int in, int out, int other,
+           sigset_t *mask, pid_t *pidp);
+int spawn(char *path, char **argv, sigset_t *mask, pid_t pgid,
+          int in, int out, pid_t *pidp);
+void do_splice(char **argv);
+void pump(int in, int out, size_t len);
+void copyall(int *fd, int n);
+void writeall(int fd, char *buf, size_t len);
+void splice_error(char *msg);
 
 void sigchld_handler(int sig);
 void sigtstp_handler(int sig);
@@ -69,17 +180,29 @@ int parseline(const char *cmdline, char **argv);
 void sigquit_handler(int sig);
 
 void clearjob(struct job_t *job);
-void initjobs(struct job_t *jobs);
-int maxjid(struct job_t *jobs); 
-int addjob(struct job_t *jobs, pid_t pid, int state, char *cmdline);
-int deletejob(struct job_t *jobs, pid_t pid); 
-pid_t fgpid(struct job_t *jobs);
-struct job_t *getjobpid(struct job_t *jobs, pid_t pid);
-struct job_t *getjobjid(struct job_t *jobs, int jid); 
+void initjobs(struct joblist_t *jobs);
+int maxjid(struct joblist_t *jobs); 
+int addjob(struct joblist_t *jobs, pid_t *pids, int n, int state, char *cmdline);
+int reapjob(struct joblist_t *jobs, struct job_t *job, pid_t pid, int status,
+            struct rusage *ru);
+void setjobstate(struct joblist_t *jobs, struct job_t *job, int state);
+int growjobs(struct joblist_t *jobs, int n);
+void hashpid(struct joblist_t *jobs, pid_t pid, struct job_t *job);
+void unhashpid(struct joblist_t *jobs, pid_t pid);
+int deletejob(struct joblist_t *jobs, pid_t pid); 
+void removejob(struct joblist_t *jobs, struct job_t *job);
+pid_t fgpid(struct joblist_t *jobs);
+struct job_t *getjobpid(struct joblist_t *jobs, pid_t pid);
+struct job_t *getjobjid(struct joblist_t *jobs, int jid); 
 int pid2jid(pid_t pid); 
-void listjobs(struct job_t *jobs);
+void listjobs(struct joblist_t *jobs);
 int getjid(char **argv);
 
+char *findcmd(char *name);
+struct hash_t *hashcmd(char *name);
+void clearhash(void);
+void listhash(void);
+
 void usage(void);
 void unix_error(char *msg);
 void app_error(char *msg);
@@ -100,7 +223,7 @@ int main(int argc, char **argv)
     dup2(1, 2);
 
     /* Parse the command line */
-    while ((c = getopt(argc, argv, "hvp")) != EOF) {
+    while ((c = getopt(argc, argv, "hvpf:")) != EOF) {
         switch (c) {
         case 'h':             /* print help message */
             usage();
@@ -111,11 +234,20 @@ int main(int argc, char **argv)
         case 'p':             /* don't print a prompt */
             emit_prompt = 0;  /* handy for automatic testing */
 	    break;
+        case 'f':             /* run the commands in a script */
+            if ((infd = open(optarg, O_RDONLY | O_CLOEXEC)) < 0)
+                unix_error(optarg);
+            emit_prompt = 0;
+	    break;
 	default:
             usage();
 	}
     }
 
+    /* The self-pipe sigchld_handler wakes the shell through */
+    if (pipe2(chldpipe, O_CLOEXEC | O_NONBLOCK) < 0)
+	unix_error("pipe error");
+
     /* Install the signal handlers */
 
     /* These are the ones you will need to implement */
@@ -132,14 +264,13 @@ int main(int argc, char **argv)
     /* Execute the shell's read/eval loop */
     while (1) {
 
-	/* Read command line */
+	/* Report on background jobs, then read command line */
+	updatejobs();
 	if (emit_prompt) {
 	    printf("%s", prompt);
 	    fflush(stdout);
 	}
-	if ((fgets(cmdline, MAXLINE, stdin) == NULL) && ferror(stdin))
-	    app_error("fgets error");
-	if (feof(stdin)) { /* End of file (ctrl-d) */
+	if (!readcmd(cmdline)) { /* End of file (ctrl-d) */
 	    fflush(stdout);
 	    exit(0);
 	}
@@ -157,8 +288,9 @@ int main(int argc, char **argv)
  * eval - Evaluate the command line that the user has just typed in
  * 
  * If the user has requested a built-in command (quit, jobs, bg or fg)
- * then execute it immediately. Otherwise, fork a child process and
- * run the job in the context of the child. If the job is running in
+ * then execute it immediately. Otherwise, start a child process for
+ * each stage of the pipeline, connected by pipes and sharing one
+ * process group, and run them as one job. If the job is running in
  * the foreground, wait for it to terminate and then return.  Note:
  * each child process must have a unique process group ID so that our
  * background children don't receive SIGINT (SIGTSTP) from the kernel
@@ -166,53 +298,326 @@ int main(int argc, char **argv)
 */
 void eval(char *cmdline) 
 {   
-    char *argv[MAXARGS];
-    int bg, stat;
-    sigset_t mask_all, all_prev, mask_chld, chld_prev;
+    char *args[MAXARGS], **argv = args;
+    char **stages[MAXPIPE];
+    int bg, jid, nstages, timed;
+    sigset_t mask;
+    struct job_t *job;
     pid_t pid;
 
-    //manipulating sigset
-    sigfillset(&mask_all);
-    sigemptyset(&mask_chld);
-    sigaddset(&mask_chld, SIGCHLD);
-
-    bg = parseline(cmdline, argv);
+    bg = parseline(cmdline, args);
     if (argv[0] == NULL) {
         return;
     }
-    if (builtin_cmd(argv)) {
+    //time prefix: report the job's (or builtin's) wall, user and sys time
+    if ((timed = !strcmp(argv[0], "time")) && (++argv)[0] == NULL) {
+        printf("Usage: time command\n");
         return;
     }
-    sigprocmask(SIG_BLOCK, &mask_chld, &chld_prev);
-    if ((pid = fork()) == 0) {
-        sigprocmask(SIG_SETMASK, &chld_prev, NULL); 
-        setpgid(0, 0);
-        if (execve(argv[0], argv, environ) < 0) {
-            printf("%s: Command not found.\n", argv[0]);
-            exit(0);
+    if ((nstages = splitpipe(argv, stages)) == 0) {
+        return;
+    }
+    if (nstages == 1) {
+        //a builtin is timed by what the shell and its children used
+        struct timespec t0, t1;
+        struct timeval u0, s0, u1, s1;
+        if (timed) {
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            shelltimes(&u0, &s0);
+        }
+        if (builtin_cmd(argv)) {
+            if (timed) {
+                clock_gettime(CLOCK_MONOTONIC, &t1);
+                shelltimes(&u1, &s1);
+                timersub(&u1, &u0, &u1);
+                timersub(&s1, &s0, &s1);
+                printtime(&t0, &t1, &u1, &s1);
+            }
+            return;
         }
-        exit(0);
     }
-    //parent zone
-    sigprocmask(SIG_SETMASK, &chld_prev, NULL); 
-    stat = bg ? BG : FG;
-    sigprocmask(SIG_SETMASK, &mask_all, &all_prev);
-    addjob(jobs, pid, stat, cmdline);
-    sigprocmask(SIG_SETMASK, &all_prev, NULL);
+    //children start with the shell's mask; their exits queue until updatejobs
+    sigprocmask(SIG_SETMASK, NULL, &mask);
+    if ((job = runjob(stages, nstages, bg ? BG : FG, cmdline, &mask)) == NULL) {
+        return;
+    }
+    job -> timed = timed;
+    pid = job -> pid;
+    jid = job -> jid;
     if (bg) {
-        int jid = pid2jid(pid);
         printf("[%d] (%d) %s", jid, pid, cmdline);
         return;
     }
     waitfg(pid);
 }
 
+/*
+ * runjob - Start the pipeline with the nstages argvs in stages, each
+ *    stage with signal mask mask, and add it to the job list in state
+ *    state. Returns the job, or NULL if no stage could be started.
+ */
+struct job_t *runjob(char ***stages, int nstages, int state, char *cmdline,
+                     sigset_t *mask)
+{
+    pid_t pids[MAXPIPE];
+    int i, n, in, fds[2];
+    sigset_t mask_all, mask_one, prev_one;
+
+    //SIGCHLD stays blocked until addjob: a stage reaped before the rest
+    //start would take the first stage's group with it, and later stages
+    //could not join it
+    sigemptyset(&mask_one);
+    sigaddset(&mask_one, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask_one, &prev_one);
+
+    //stage i reads the pipe stage i-1 writes, all join the first's group
+    n = 0;
+    in = STDIN_FILENO;
+    fds[0] = -1;
+    for (i = 0; i < nstages; i++) {
+        int out = STDOUT_FILENO;
+        if (i < nstages - 1) {
+            if (pipe2(fds, O_CLOEXEC) < 0)
+                unix_error("pipe error");
+            out = fds[1];
+        } else {
+            fds[0] = -1;
+        }
+        if (launch(stages[i], n ? pids[0] : 0, in, out, fds[0],
+                   mask, &pids[n]) == 0)
+            n++;
+        if (in != STDIN_FILENO)
+            close(in);
+        if (out != STDOUT_FILENO)
+            close(out);
+        in = fds[0];
+    }
+    if (n == 0) {
+        sigprocmask(SIG_SETMASK, &prev_one, NULL);
+        return NULL;
+    }
+    sigfillset(&mask_all);
+    sigprocmask(SIG_SETMASK, &mask_all, NULL);
+    addjob(jobs, pids, n, state, cmdline);
+    sigprocmask(SIG_SETMASK, &prev_one, NULL);
+    return getjobpid(jobs, pids[0]);
+}
+
+/*
+ * readcmd - Read the next line of input, newline included, into line
+ *    (MAXLINE bytes; a longer line is split). Input is read INBUF bytes
+ *    at a time, so a script costs a read per INBUF bytes, not per
+ *    line. While waiting for more, jobs that change state are reported
+ *    as it happens. Returns 0 at end of input.
+ */
+int readcmd(char *line)
+{
+    struct pollfd pfd[2];
+    size_t n = 0, len;
+    ssize_t r;
+    char *nl;
+
+    while (n < MAXLINE - 1) {
+        if (inpos == inlen) {
+            pfd[0].fd = infd;
+            pfd[0].events = POLLIN;
+            pfd[1].fd = chldpipe[0];
+            pfd[1].events = POLLIN;
+            if (poll(pfd, 2, -1) < 0) {
+                if (errno == EINTR)
+                    continue;
+                unix_error("poll error");
+            }
+            if (pfd[1].revents) {
+                updatejobs();
+                fflush(stdout);
+            }
+            if (pfd[0].revents == 0)
+                continue;
+            if ((r = read(infd, inbuf, INBUF)) < 0) {
+                if (errno == EINTR)
+                    continue;
+                unix_error("read error");
+            }
+            if (r == 0)
+                break;
+            inpos = 0;
+            inlen = r;
+        }
+        len = inlen - inpos;
+        if (len > MAXLINE - 1 - n)
+            len = MAXLINE - 1 - n;
+        if ((nl = memchr(inbuf + inpos, '\n', len)) != NULL)
+            len = nl - (inbuf + inpos) + 1;
+        memcpy(line + n, inbuf + inpos, len);
+        inpos += len;
+        n += len;
+        if (nl != NULL)
+            break;
+    }
+    if (n == 0)
+        return 0;
+    if (line[n - 1] != '\n' && n < MAXLINE - 1)
+        line[n++] = '\n';  /* last line had no newline */
+    line[n] = '\0';
+    return 1;
+}
+
+/*
+ * printtime - Report the wall time from start to end and the user and
+ *    system time for the time builtin
+ */
+void printtime(struct timespec *start, struct timespec *end,
+               struct timeval *utime, struct timeval *stime)
+{
+    printf("real %.3fs  user %.3fs  sys %.3fs\n",
+           (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9,
+           utime->tv_sec + utime->tv_usec / 1e6,
+           stime->tv_sec + stime->tv_usec / 1e6);
+}
+
+/* shelltimes - User and system time of the shell plus its reaped children */
+void shelltimes(struct timeval *utime, struct timeval *stime)
+{
+    struct rusage self, children;
+
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    timeradd(&self.ru_utime, &children.ru_utime, utime);
+    timeradd(&self.ru_stime, &children.ru_stime, stime);
+}
+
+/*
+ * splitpipe - Cut argv at each pipetok into the argv of each pipeline
+ *    stage. Returns the number of stages, or 0 after printing an error
+ *    if a stage is empty or there are more than MAXPIPE.
+ */
+int splitpipe(char **argv, char ***stages)
+{
+    int i, n = 0;
+
+    stages[n++] = argv;
+    for (i = 0; argv[i] != NULL; i++) {
+        if (argv[i] != pipetok)
+            continue;
+        argv[i] = NULL;
+        if (n == MAXPIPE) {
+            printf("Too many pipeline stages\n");
+            return 0;
+        }
+        stages[n++] = &argv[i + 1];
+    }
+    for (i = 0; i < n; i++) {
+        if (stages[i][0] == NULL) {
+            printf("Syntax error near '|'\n");
+            return 0;
+        }
+    }
+    return n;
+}
+
+/*
+ * launch - Start one pipeline stage in process group pgid (a new group
+ *    if 0) with in and out as its stdin and stdout. other is the pipe
+ *    end the stage must not keep open, or -1. The splice builtin runs
+ *    in a forked child; everything else is spawned. Returns 0 with the
+ *    child in *pidp, or -1 after reporting the error.
+ */
+int launch(char **argv, pid_t pgid, int in, int out, int other,
+           sigset_t *mask, pid_t *pidp)
+{
+    char *path;
+    pid_t pid;
+    int err;
+
+    if (!strcmp(argv[0], "splice")) {
+        fflush(stdout);
+        if ((pid = fork()) == 0) {
+            setpgid(0, pgid);
+            Signal(SIGINT, SIG_DFL);
+            Signal(SIGTSTP, SIG_DFL);
+            Signal(SIGCHLD, SIG_DFL);
+            Signal(SIGQUIT, SIG_DFL);
+            sigprocmask(SIG_SETMASK, mask, NULL);
+            if (other >= 0)
+                close(other);
+            close(chldpipe[0]);
+            close(chldpipe[1]);
+            if (in != STDIN_FILENO) {
+                dup2(in, STDIN_FILENO);
+                close(in);
+            }
+            if (out != STDOUT_FILENO) {
+                dup2(out, STDOUT_FILENO);
+                close(out);
+            }
+            do_splice(argv);
+            exit(0);
+        }
+        if (pid < 0) {
+            printf("%s: %s\n", argv[0], strerror(errno));
+            return -1;
+        }
+        setpgid(pid, pgid ? pgid : pid);
+        *pidp = pid;
+        return 0;
+    }
+
+    //resolve in the parent so the hash table outlives the child
+    path = findcmd(argv[0]);
+    if ((err = spawn(path, argv, mask, pgid, in, out, pidp)) != 0) {
+        if (err == EAGAIN || err == ENOMEM)
+            printf("%s: %s\n", argv[0], strerror(err));
+        else
+            printf("%s: Command not found.\n", argv[0]);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * spawn - Start path in a child process in process group pgid (a new
+ *    group if 0) with signal mask mask and in and out as its stdin and
+ *    stdout. posix_spawn shares the shell's address space with the
+ *    child until it execs, so the cost doesn't grow with the size of
+ *    the shell. Returns 0 with the child in *pidp, or an error number,
+ *    which includes the exec failing.
+ */
+int spawn(char *path, char **argv, sigset_t *mask, pid_t pgid,
+          int in, int out, pid_t *pidp)
+{
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    int err;
+
+    if ((err = posix_spawnattr_init(&attr)) != 0)
+        return err;
+    if ((err = posix_spawn_file_actions_init(&actions)) != 0) {
+        posix_spawnattr_destroy(&attr);
+        return err;
+    }
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK |
+                             POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setsigmask(&attr, mask);
+    posix_spawnattr_setpgroup(&attr, pgid);
+    //the pipe fds themselves are close-on-exec
+    if (in != STDIN_FILENO)
+        posix_spawn_file_actions_adddup2(&actions, in, STDIN_FILENO);
+    if (out != STDOUT_FILENO)
+        posix_spawn_file_actions_adddup2(&actions, out, STDOUT_FILENO);
+    err = posix_spawn(pidp, path, &actions, &attr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    return err;
+}
+
 /* 
  * parseline - Parse the command line and build the argv array.
  * 
  * Characters enclosed in single quotes are treated as a single
- * argument.  Return true if the user has requested a BG job, false if
- * the user has requested a FG job.  
+ * argument.  An unquoted '|' is an argument of its own, set to pipetok
+ * so that a quoted "|" can be told apart.  Return true if the user has
+ * requested a BG job, false if the user has requested a FG job.  
  */
 int parseline(const char *cmdline, char **argv) 
 {
@@ -224,32 +629,40 @@ int parseline(const char *cmdline, char **argv)
 
     strcpy(buf, cmdline);
     buf[strlen(buf)-1] = ' ';  /* replace trailing '\n' with space */
-    while (*buf && (*buf == ' ')) /* ignore leading spaces */
-	buf++;
 
     /* Build the argv list */
     argc = 0;
+    while (*buf && (*buf == ' ' || *buf == '|')) { /* ignore leading spaces */
+	if (*buf == '|')
+	    argv[argc++] = pipetok;
+	buf++;
+    }
     if (*buf == '\'') {
 	buf++;
 	delim = strchr(buf, '\'');
     }
     else {
-	delim = strchr(buf, ' ');
+	delim = strpbrk(buf, " |");
     }
 
     while (delim) {
 	argv[argc++] = buf;
+	if (*delim == '|')
+	    argv[argc++] = pipetok;
 	*delim = '\0';
 	buf = delim + 1;
-	while (*buf && (*buf == ' ')) /* ignore spaces */
-	       buf++;
+	while (*buf && (*buf == ' ' || *buf == '|')) { /* ignore spaces */
+	    if (*buf == '|')
+		argv[argc++] = pipetok;
+	    buf++;
+	}
 
 	if (*buf == '\'') {
 	    buf++;
 	    delim = strchr(buf, '\'');
 	}
 	else {
-	    delim = strchr(buf, ' ');
+	    delim = strpbrk(buf, " |");
 	}
     }
     argv[argc] = NULL;
@@ -286,6 +699,14 @@ int builtin_cmd(char **argv)
         do_bgfg(argv);
         return 1;
     }
+    if (!strcmp(argv[0], "hash")) {
+        do_hash(argv);
+        return 1;
+    }
+    if (!strcmp(argv[0], "parallel")) {
+        do_parallel(argv);
+        return 1;
+    }
     return 0;
 }
 
@@ -328,26 +749,402 @@ void do_bgfg(char **argv)
     sigprocmask(SIG_SETMASK, &mask_all, &all_prev);
     kill(-pid, SIGCONT);
     if (bg2fg) {
-        job -> state = FG;
+        setjobstate(jobs, job, FG);
         sigprocmask(SIG_SETMASK, &all_prev, NULL);
         waitfg(pid);
     } else {
         char *cmd = job -> cmdline;
         int jid = job -> jid;
         printf("[%d] (%d) %s", jid, pid, cmd);
-        job -> state = BG;
+        setjobstate(jobs, job, BG);
         sigprocmask(SIG_SETMASK, &all_prev, NULL);
     }
 }
 
+/*
+ * do_hash - Execute the builtin hash command: with no arguments list
+ *    the remembered commands, with -r forget them all, otherwise look
+ *    up and remember each named command
+ */
+void do_hash(char **argv)
+{
+    int i;
+
+    if (argv[1] == NULL) {
+        listhash();
+        return;
+    }
+    if (!strcmp(argv[1], "-r")) {
+        clearhash();
+        return;
+    }
+    for (i = 1; argv[i] != NULL; i++) {
+        if (strchr(argv[i], '/') == NULL && hashcmd(argv[i]) == NULL)
+            printf("hash: %s: not found\n", argv[i]);
+    }
+}
+
+/*
+ * do_splice - Run the builtin splice stage: copy stdin to stdout and
+ *    to each file argument. What waits in the stdin pipe is duplicated
+ *    for the files with tee and moved on with splice, so it never
+ *    passes through user space. Where the fds don't allow that it is
+ *    copied instead: stdin is not a pipe while there are files, or
+ *    neither end is a pipe, or the other end can't take a splice.
+ */
+void do_splice(char **argv)
+{
+    int fd[MAXARGS], tp[MAXARGS][2];
+    int i, n;
+    struct stat st;
+    ssize_t len;
+
+    for (n = 0; argv[n + 1] != NULL; n++) {
+        fd[n] = open(argv[n + 1], O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd[n] < 0) {
+            splice_error(argv[n + 1]);
+        }
+    }
+    if (n == 0) {
+        while ((len = splice(STDIN_FILENO, NULL, STDOUT_FILENO, NULL,
+                             SPLICECHUNK, SPLICE_F_MOVE)) != 0) {
+            if (len < 0 && errno == EINVAL)
+                break;
+            if (len < 0 && errno != EINTR)
+                splice_error("splice");
+        }
+        if (len == 0)
+            return;
+    } else if (fstat(STDIN_FILENO, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        for (i = 0; i < n; i++)
+            if (pipe(tp[i]) < 0)
+                splice_error("pipe");
+        while ((len = tee(STDIN_FILENO, tp[0][1], SPLICECHUNK, 0)) != 0) {
+            if (len < 0 && errno == EINTR)
+                continue;
+            if (len < 0)
+                splice_error("tee");
+            //the tee pipes are empty, so each takes all len bytes
+            for (i = 1; i < n; i++)
+                if (tee(STDIN_FILENO, tp[i][1], len, 0) != len)
+                    splice_error("tee");
+            for (i = 0; i < n; i++)
+                pump(tp[i][0], fd[i], len);
+            pump(STDIN_FILENO, STDOUT_FILENO, len);
+        }
+        return;
+    }
+    copyall(fd, n);
+}
+
+/*
+ * pump - Move exactly len bytes from in to out with splice, falling
+ *    back to read and write if out doesn't support it
+ */
+void pump(int in, int out, size_t len)
+{
+    char buf[MAXLINE];
+    ssize_t n;
+
+    while (len > 0) {
+        n = splice(in, NULL, out, NULL, len, SPLICE_F_MOVE);
+        if (n < 0 && errno == EINVAL) {
+            n = read(in, buf, len < sizeof(buf) ? len : sizeof(buf));
+            if (n > 0)
+                writeall(out, buf, n);
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            splice_error("splice");
+        len -= n;
+    }
+}
+
+/* copyall - Copy the rest of stdin to stdout and to the n files in fd */
+void copyall(int *fd, int n)
+{
+    char buf[SPLICECHUNK];
+    ssize_t len;
+    int i;
+
+    while ((len = read(STDIN_FILENO, buf, sizeof(buf))) != 0) {
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len < 0)
+            splice_error("read");
+        for (i = 0; i < n; i++)
+            writeall(fd[i], buf, len);
+        writeall(STDOUT_FILENO, buf, len);
+    }
+}
+
+/*
+ * splice_error - Report an error in the splice builtin and exit. It
+ *    goes to stderr, since stdout is the pipe to the next stage.
+ */
+void splice_error(char *msg)
+{
+    fprintf(stderr, "splice: %s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+/* writeall - Write all len bytes of buf to fd */
+void writeall(int fd, char *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = write(fd, buf, len)) < 0) {
+            if (errno == EINTR)
+                continue;
+            splice_error("write");
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+/*
+ * do_parallel - Execute the builtin parallel command
+ *
+ *    parallel [-j N] cmd [arg...] ::: x y ...
+ *    parallel [-j N]
+ *
+ * The first form runs cmd once for each word after :::, with the word
+ * in place of each {} argument, or appended if there is none. The
+ * second runs each command line read from the shell's input (stdin or
+ * the -f script) up to EOF. At most N
+ * (default: the number of CPUs) of them run at a time, each a
+ * background job of its own; the next one starts as soon as
+ * updatejobs sees one end. A job stopped from outside is continued,
+ * since parallel waits for every job to end. Once all are done, prints
+ * how each one ended and how long it ran.
+ */
+void do_parallel(char **argv)
+{
+    char line[MAXLINE], *args[MAXARGS], **stages[MAXPIPE];
+    sigset_t mask, intmask;
+    struct timespec t0, t1;
+    struct job_t *job;
+    struct run_t *list;
+    int i, j, k, n, sep, size, nfail, nstages, maxrun;
+
+    maxrun = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    i = 1;
+    if (argv[i] != NULL && !strncmp(argv[i], "-j", 2)) {
+        char *jarg = argv[i][2] ? &argv[i][2] : argv[++i];
+        if (jarg == NULL || (maxrun = atoi(jarg)) < 1) {
+            printf("parallel: -j requires a positive number\n");
+            return;
+        }
+        i++;
+    }
+    if (maxrun < 1)
+        maxrun = 1;
+    for (sep = i; argv[sep] != NULL && strcmp(argv[sep], ":::"); sep++)
+        ;
+    if (argv[sep] != NULL && sep == i) {
+        printf("parallel: no command before :::\n");
+        return;
+    }
+
+    /* collect the command lines */
+    n = 0;
+    size = MINJOBS;
+    if ((list = malloc(size * sizeof(struct run_t))) == NULL)
+        unix_error("malloc error");
+    for (k = sep + 1; argv[sep] != NULL ? argv[k] != NULL :
+             readcmd(line); k++) {
+        if (argv[sep] != NULL) {
+            //{} in a word becomes the next word after :::, or it is
+            //appended; words with spaces are quoted for parseline
+            char word[MAXLINE], *p, *q;
+            int len = 0, used = 0, w;
+            //snprintf returns what it would have written: past MAXLINE
+            //the line was cut short
+            for (j = i; j <= sep && len < MAXLINE; j++) {
+                if (j == sep && used)
+                    break;
+                w = 0;
+                for (p = j < sep ? argv[j] : "{}";
+                     w < MAXLINE && (q = strstr(p, "{}")) != NULL; p = q + 2) {
+                    w += snprintf(word + w, MAXLINE - w, "%.*s%s",
+                                  (int)(q - p), p, argv[k]);
+                    used = 1;
+                }
+                if (w < MAXLINE)
+                    w += snprintf(word + w, MAXLINE - w, "%s", p);
+                if (w >= MAXLINE)
+                    len = MAXLINE;
+                else
+                    len += snprintf(line + len, MAXLINE - len,
+                                    strchr(word, ' ') ? "%s'%s'" : "%s%s",
+                                    j > i ? " " : "", word);
+            }
+            if (len >= MAXLINE - 1) {
+                printf("parallel: command line for %.32s... too long\n", argv[k]);
+                for (j = 0; j < n; j++)
+                    free(list[j].cmdline);
+                free(list);
+                return;
+            }
+            snprintf(line + len, MAXLINE - len, "\n");
+        } else if (strspn(line, " \t\n") == strlen(line)) {
+            continue;
+        }
+        if (n == size) {
+            struct run_t *more = realloc(list, 2 * size * sizeof(struct run_t));
+            if (more == NULL)
+                unix_error("realloc error");
+            list = more;
+            size *= 2;
+        }
+        memset(&list[n], 0, sizeof(struct run_t));
+        if ((list[n].cmdline = strdup(line)) == NULL)
+            unix_error("strdup error");
+        n++;
+    }
+
+    /* keep maxrun of them going; updatejobs counts them down */
+    sigprocmask(SIG_SETMASK, NULL, &mask);
+    sigemptyset(&intmask);
+    sigaddset(&intmask, SIGINT);
+    nrunning = 0;
+    runabort = 0;
+    runs = list;
+    nruns = n;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (k = 0; k < nruns && !runabort; k++) {
+        while (nrunning >= maxrun && !runabort)
+            waitchld();
+        if (runabort)
+            break;
+        parseline(runs[k].cmdline, args);
+        if (args[0] == NULL || (nstages = splitpipe(args, stages)) == 0)
+            continue;
+        clock_gettime(CLOCK_MONOTONIC, &runs[k].start);
+        //a ctrl-c before runs[k].pid is set would miss job k
+        sigprocmask(SIG_BLOCK, &intmask, NULL);
+        if ((job = runjob(stages, nstages, BG, runs[k].cmdline, &mask)) != NULL) {
+            job -> run = k;
+            runs[k].pid = job -> pid;
+            nrunning++;
+        }
+        sigprocmask(SIG_SETMASK, &mask, NULL);
+    }
+    while (nrunning > 0)
+        waitchld();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    runs = NULL;
+    nruns = 0;
+
+    /* report */
+    nfail = 0;
+    printf("job  status       wall(s)  command\n");
+    for (k = 0; k < n; k++) {
+        struct run_t *r = &list[k];
+        char how[32];
+        if (r->pid == 0)
+            snprintf(how, sizeof(how), "not run");
+        else if (WIFEXITED(r->status))
+            snprintf(how, sizeof(how), "exit %d", WEXITSTATUS(r->status));
+        else
+            snprintf(how, sizeof(how), "signal %d", WTERMSIG(r->status));
+        nfail += (r->pid == 0 || r->status != 0);
+        printf("%3d  %-10s %9.3f  %s", k + 1, how,
+               r->pid ? (r->end.tv_sec - r->start.tv_sec) +
+                        (r->end.tv_nsec - r->start.tv_nsec) / 1e9 : 0.0,
+               r->cmdline);
+        free(r->cmdline);
+    }
+    printf("%d jobs, %d failed, %.3f s\n", n, nfail,
+           (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+    free(list);
+}
+
 /* 
  * waitfg - Block until process pid is no longer the foreground process
  */
 void waitfg(pid_t pid)
 {
-    //using busy loop & sleep
+    updatejobs();
     while (fgpid(jobs) == pid) {
-        sleep(1);
+        waitchld();
+    }
+}
+
+/* 
+ * waitchld - Sleep until sigchld_handler has queued something, or a
+ *    signal interrupts, then apply whatever was queued. A reap that
+ *    lands before the poll leaves chldpipe readable, so none is missed.
+ */
+void waitchld(void)
+{
+    struct pollfd pfd;
+
+    pfd.fd = chldpipe[0];
+    pfd.events = POLLIN;
+    poll(&pfd, 1, -1);
+    updatejobs();
+}
+
+/* 
+ * updatejobs - Apply the child state changes sigchld_handler queued to
+ *    the job list, and report stopped and killed jobs
+ */
+void updatejobs(void)
+{
+    char buf[64];
+    struct chld_t ev;
+    struct job_t *job;
+    sigset_t mask_all, all_prev;
+
+    while (read(chldpipe[0], buf, sizeof(buf)) > 0)
+        ;
+    sigfillset(&mask_all);
+    sigprocmask(SIG_SETMASK, &mask_all, &all_prev);
+    while (ringtail != ringhead) {
+        atomic_signal_fence(memory_order_acquire);
+        ev = ring[ringtail];
+        atomic_signal_fence(memory_order_release);
+        ringtail = (ringtail + 1) & (RINGSIZE - 1);
+
+        if ((job = getjobpid(jobs, ev.pid)) == NULL) {
+            //not one of ours
+        } else if (WIFSTOPPED(ev.status) && job -> run >= 0) {
+            //parallel only returns once its jobs end, so keep them going
+            printf("Job [%d] (%d) stopped by signal %d, continued\n",
+                   job -> jid, job -> pid, WSTOPSIG(ev.status));
+            kill(-job -> pid, SIGCONT);
+        } else if (WIFSTOPPED(ev.status)) {
+            //received stop, reported once for the whole pipeline
+            if (job -> state != ST) {
+                setjobstate(jobs, job, ST);
+                printf("Job [%d] (%d) stopped by signal %d\n",
+                       job -> jid, job -> pid, WSTOPSIG(ev.status));
+            }
+        } else if (reapjob(jobs, job, ev.pid, ev.status, &ev.ru)) {
+            //reaped the last process; the job ends as its last stage did
+            if (job -> run >= 0) {
+                struct run_t *r = &runs[job -> run];
+                r -> end = ev.when;
+                r -> status = job -> status;
+                r -> done = 1;
+                nrunning--;
+            } else if (WIFSIGNALED(job -> status))
+                printf("Job [%d] (%d) terminated by signal %d\n",
+                       job -> jid, job -> pid, WTERMSIG(job -> status));
+            if (job -> timed)
+                printtime(&job -> start, &ev.when, &job -> utime, &job -> stime);
+            removejob(jobs, job);
+        }
+    }
+    sigprocmask(SIG_SETMASK, &all_prev, NULL);
+    //the handler stopped at a full ring; have it reap the rest
+    if (ringfull) {
+        ringfull = 0;
+        raise(SIGCHLD);
     }
 }
 
@@ -360,51 +1157,50 @@ void waitfg(pid_t pid)
  *     a child job terminates (becomes a zombie), or stops because it
  *     received a SIGSTOP or SIGTSTP signal. The handler reaps all
  *     available zombie children, but doesn't wait for any other
- *     currently running children to terminate.  
+ *     currently running children to terminate. It only queues what
+ *     it reaped for updatejobs and wakes the shell through chldpipe;
+ *     everything here is async-signal-safe.
  */
 void sigchld_handler(int sig) 
 { 
-    int stat;
-    sigset_t mask_all, all_prev;
+    int olderrno = errno, stat, next;
     pid_t pid;
 
-    sigfillset(&mask_all);
-
-    while ((pid = waitpid(-1, &stat, WUNTRACED | WNOHANG)) > 0) {
-        if (WIFEXITED(stat)) {
-            //reap zombie
-            sigprocmask(SIG_SETMASK, &mask_all, &all_prev);
-            deletejob(jobs, pid);
-            sigprocmask(SIG_SETMASK, &all_prev, NULL);
-        } else if (WIFSIGNALED(stat)) {
-            //received interrupt
-            sigprocmask(SIG_SETMASK, &mask_all, &all_prev);
-            int jid = pid2jid(pid);
-            deletejob(jobs, pid);
-            printf("Job [%d] (%d) terminated by signal 2\n", jid, pid);
-            sigprocmask(SIG_SETMASK, &all_prev, NULL);
-        } else if (WIFSTOPPED(stat)) {
-            //received stop
-            sigprocmask(SIG_SETMASK, &mask_all, &all_prev);
-            struct job_t *job = getjobpid(jobs, pid);
-            job -> state = ST;
-            int jid = job -> jid;
-            printf("Job [%d] (%d) stopped by signal 20\n", jid, pid);
-            sigprocmask(SIG_SETMASK, &all_prev, NULL);
-        }
+    while ((next = (ringhead + 1) & (RINGSIZE - 1)) != ringtail) {
+        if ((pid = wait4(-1, &stat, WUNTRACED | WNOHANG,
+                         &ring[ringhead].ru)) <= 0)
+            break;
+        ring[ringhead].pid = pid;
+        ring[ringhead].status = stat;
+        clock_gettime(CLOCK_MONOTONIC, &ring[ringhead].when);
+        atomic_signal_fence(memory_order_release);
+        ringhead = next;
     }
+    if (next == ringtail)
+        ringfull = 1;
+    write(chldpipe[1], "", 1);
+    errno = olderrno;
 }
 
 /* 
  * sigint_handler - The kernel sends a SIGINT to the shell whenver the
  *    user types ctrl-c at the keyboard.  Catch it and send it along
- *    to the foreground job.  
+ *    to the foreground job, or to every job the parallel builtin has
+ *    running.  
  */
 void sigint_handler(int sig) 
 {
+    int i;
     pid_t fpid = fgpid(jobs);
     if (fpid != 0) {
         kill(-fpid, SIGINT);
+    } else if (runs != NULL) {
+        //the parallel builtin is in the foreground
+        runabort = 1;
+        for (i = 0; i < nruns; i++) {
+            if (runs[i].pid != 0 && !runs[i].done)
+                kill(-runs[i].pid, SIGINT);
+        }
     }
 }
 
@@ -434,130 +1230,277 @@ void clearjob(struct job_t *job) {
     job->pid = 0;
     job->jid = 0;
     job->state = UNDEF;
+    job->nprocs = 0;
+    job->live = 0;
+    job->status = 0;
+    job->run = -1;
+    job->timed = 0;
+    timerclear(&job->utime);
+    timerclear(&job->stime);
     job->cmdline[0] = '\0';
 }
 
 /* initjobs - Initialize the job list */
-void initjobs(struct job_t *jobs) {
-    int i;
-
-    for (i = 0; i < MAXJOBS; i++)
-	clearjob(&jobs[i]);
+void initjobs(struct joblist_t *jobs) {
+    memset(jobs, 0, sizeof(*jobs));
+    if (!growjobs(jobs, MINJOBS))
+	app_error("initjobs: out of memory");
 }
 
 /* maxjid - Returns largest allocated job ID */
-int maxjid(struct job_t *jobs) 
+int maxjid(struct joblist_t *jobs) 
 {
-    int i, max=0;
-
-    for (i = 0; i < MAXJOBS; i++)
-	if (jobs[i].jid > max)
-	    max = jobs[i].jid;
-    return max;
+    return jobs->maxjid;
 }
 
-/* addjob - Add a job to the job list */
-int addjob(struct job_t *jobs, pid_t pid, int state, char *cmdline) 
+/* 
+ * growjobs - Make room for n more jobs than there are already. byjid
+ *    and bypid move, but no handler reads them: the job list is only
+ *    changed in the main flow (updatejobs included), and the ctrl-c and
+ *    ctrl-z handlers follow jobs->fg, whose job is never moved. Returns
+ *    0 if out of memory.
+ */
+int growjobs(struct joblist_t *jobs, int n)
 {
-    int i;
-    
-    if (pid < 1)
+    struct job_t *block;
+    struct pident_t *old = jobs->bypid;
+    int i, oldsize = jobs->pidsize;
+
+    /* the jobs themselves */
+    if ((block = malloc(n * sizeof(struct job_t))) == NULL)
 	return 0;
+    for (i = 0; i < n; i++) {
+	clearjob(&block[i]);
+	block[i].next = jobs->free;
+	jobs->free = &block[i];
+    }
 
-    for (i = 0; i < MAXJOBS; i++) {
-	if (jobs[i].pid == 0) {
-	    jobs[i].pid = pid;
-	    jobs[i].state = state;
-	    jobs[i].jid = nextjid++;
-	    if (nextjid > MAXJOBS)
-		nextjid = 1;
-	    strcpy(jobs[i].cmdline, cmdline);
-  	    if(verbose){
-	        printf("Added job [%d] %d %s\n", jobs[i].jid, jobs[i].pid, jobs[i].cmdline);
-            }
-            return 1;
+    /* JID index, JIDs run from 1 to at most the number of jobs */
+    if (jobs->size < MAXJID + 1) {
+	int size = jobs->size ? 2 * jobs->size : MINJOBS + 1;
+	struct job_t **byjid;
+	if (size > MAXJID + 1)
+	    size = MAXJID + 1;
+	if ((byjid = realloc(jobs->byjid, size * sizeof(*byjid))) == NULL)
+	    return 0;
+	memset(byjid + jobs->size, 0, (size - jobs->size) * sizeof(*byjid));
+	jobs->byjid = byjid;
+	jobs->size = size;
+    }
+
+    /* PID table, kept at most half full and rehashed into */
+    jobs->pidsize = oldsize ? 2 * oldsize : 4 * MINJOBS;
+    while (jobs->pidsize < 4 * n)
+	jobs->pidsize *= 2;
+    if ((jobs->bypid = calloc(jobs->pidsize, sizeof(struct pident_t))) == NULL) {
+	jobs->bypid = old;
+	jobs->pidsize = oldsize;
+	return 0;
+    }
+    jobs->npids = 0;
+    for (i = 0; i < oldsize; i++)
+	if (old[i].pid != 0)
+	    hashpid(jobs, old[i].pid, old[i].job);
+    free(old);
+    return 1;
+}
+
+/* pidslot - Home slot of pid in the PID table */
+static int pidslot(struct joblist_t *jobs, pid_t pid)
+{
+    return ((unsigned)pid * 2654435761u) & (jobs->pidsize - 1);
+}
+
+/* hashpid - Enter pid as a process of job in the PID table */
+void hashpid(struct joblist_t *jobs, pid_t pid, struct job_t *job)
+{
+    int i = pidslot(jobs, pid);
+
+    while (jobs->bypid[i].pid != 0)
+	i = (i + 1) & (jobs->pidsize - 1);
+    jobs->bypid[i].pid = pid;
+    jobs->bypid[i].job = job;
+    jobs->npids++;
+}
+
+/* 
+ * unhashpid - Remove pid from the PID table. Later entries of the probe
+ *    run are shifted back into the hole, so the table never needs
+ *    tombstones and lookups never slow down as jobs come and go.
+ */
+void unhashpid(struct joblist_t *jobs, pid_t pid)
+{
+    int mask = jobs->pidsize - 1;
+    int i = pidslot(jobs, pid), j, home;
+
+    while (jobs->bypid[i].pid != pid) {
+	if (jobs->bypid[i].pid == 0)
+	    return;
+	i = (i + 1) & mask;
+    }
+    for (j = (i + 1) & mask; jobs->bypid[j].pid != 0; j = (j + 1) & mask) {
+	/* move j into the hole at i unless its home lies in (i, j] */
+	home = pidslot(jobs, jobs->bypid[j].pid);
+	if (((j - home) & mask) >= ((j - i) & mask)) {
+	    jobs->bypid[i] = jobs->bypid[j];
+	    i = j;
 	}
     }
-    printf("Tried to create too many jobs\n");
-    return 0;
+    jobs->bypid[i].pid = 0;
+    jobs->npids--;
 }
 
-/* deletejob - Delete a job whose PID=pid from the job list */
-int deletejob(struct job_t *jobs, pid_t pid) 
+/* addjob - Add a job of the n processes in pids to the job list */
+int addjob(struct joblist_t *jobs, pid_t *pids, int n, int state, char *cmdline) 
 {
-    int i;
+    struct job_t *job;
+    int i, jid;
+    
+    if (n < 1 || pids[0] < 1)
+	return 0;
 
-    if (pid < 1)
+    /* a JID past the top is free; only once those run out look lower */
+    jid = jobs->maxjid + 1;
+    if (jid > MAXJID) {
+	for (jid = 1; jid <= MAXJID && jobs->byjid[jid] != NULL; jid++)
+	    ;
+    }
+    if (jid > MAXJID ||
+	((jobs->free == NULL || jid >= jobs->size ||
+	  2 * (jobs->npids + n) > jobs->pidsize) &&
+	 !growjobs(jobs, jobs->size > n ? jobs->size : n))) {
+	printf("Tried to create too many jobs\n");
 	return 0;
+    }
 
-    for (i = 0; i < MAXJOBS; i++) {
-	if (jobs[i].pid == pid) {
-	    clearjob(&jobs[i]);
-	    nextjid = maxjid(jobs)+1;
-	    return 1;
+    job = jobs->free;
+    jobs->free = job->next;
+    job->pid = pids[0];
+    job->jid = jid;
+    job->nprocs = n;
+    job->live = n;
+    memcpy(job->pids, pids, n * sizeof(pid_t));
+    strcpy(job->cmdline, cmdline);
+    clock_gettime(CLOCK_MONOTONIC, &job->start);
+    setjobstate(jobs, job, state);
+    jobs->byjid[jid] = job;
+    if (jid > jobs->maxjid)
+	jobs->maxjid = jid;
+    for (i = 0; i < n; i++)
+	hashpid(jobs, pids[i], job);
+    if(verbose){
+	printf("Added job [%d] %d %s\n", job->jid, job->pid, job->cmdline);
+    }
+    return 1;
+}
+
+/* setjobstate - Change the state of job, keeping track of the FG job */
+void setjobstate(struct joblist_t *jobs, struct job_t *job, int state)
+{
+    job->state = state;
+    if (state == FG)
+	jobs->fg = job;
+    else if (jobs->fg == job)
+	jobs->fg = NULL;
+}
+
+/* 
+ * reapjob - Note that process pid of job has terminated with wait
+ *    status status and resource usage ru. Returns 1 once all of the
+ *    job's processes have.
+ */
+int reapjob(struct joblist_t *jobs, struct job_t *job, pid_t pid, int status,
+            struct rusage *ru)
+{
+    int i;
+
+    for (i = 0; i < job->nprocs; i++) {
+	if (job->pids[i] == pid) {
+	    job->pids[i] = 0;
+	    job->live--;
+	    timeradd(&job->utime, &ru->ru_utime, &job->utime);
+	    timeradd(&job->stime, &ru->ru_stime, &job->stime);
+	    unhashpid(jobs, pid);
+	    if (i == job->nprocs - 1)
+		job->status = status;
 	}
     }
-    return 0;
+    return job->live == 0;
 }
 
-/* fgpid - Return PID of current foreground job, 0 if no such job */
-pid_t fgpid(struct job_t *jobs) {
+/* deletejob - Delete a job whose PID=pid from the job list */
+int deletejob(struct joblist_t *jobs, pid_t pid) 
+{
+    struct job_t *job;
+
+    if ((job = getjobpid(jobs, pid)) == NULL)
+	return 0;
+    removejob(jobs, job);
+    return 1;
+}
+
+/* removejob - Delete job from the job list */
+void removejob(struct joblist_t *jobs, struct job_t *job)
+{
     int i;
 
-    for (i = 0; i < MAXJOBS; i++)
-	if (jobs[i].state == FG)
-	    return jobs[i].pid;
-    return 0;
+    for (i = 0; i < job->nprocs; i++)
+	if (job->pids[i] != 0)
+	    unhashpid(jobs, job->pids[i]);
+    if (jobs->fg == job)
+	jobs->fg = NULL;
+    jobs->byjid[job->jid] = NULL;
+    while (jobs->maxjid > 0 && jobs->byjid[jobs->maxjid] == NULL)
+	jobs->maxjid--;
+    clearjob(job);
+    job->next = jobs->free;
+    jobs->free = job;
+}
+
+/* fgpid - Return PID of current foreground job, 0 if no such job */
+pid_t fgpid(struct joblist_t *jobs) {
+    return jobs->fg ? jobs->fg->pid : 0;
 }
 
-/* getjobpid  - Find a job (by PID) on the job list */
-struct job_t *getjobpid(struct job_t *jobs, pid_t pid) {
+/* getjobpid  - Find a job (by the PID of any of its processes) on the job list */
+struct job_t *getjobpid(struct joblist_t *jobs, pid_t pid) {
     int i;
 
     if (pid < 1)
 	return NULL;
-    for (i = 0; i < MAXJOBS; i++)
-	if (jobs[i].pid == pid)
-	    return &jobs[i];
+    for (i = pidslot(jobs, pid); jobs->bypid[i].pid != 0;
+	 i = (i + 1) & (jobs->pidsize - 1))
+	if (jobs->bypid[i].pid == pid)
+	    return jobs->bypid[i].job;
     return NULL;
 }
 
 /* getjobjid  - Find a job (by JID) on the job list */
-struct job_t *getjobjid(struct job_t *jobs, int jid) 
+struct job_t *getjobjid(struct joblist_t *jobs, int jid) 
 {
-    int i;
-
-    if (jid < 1)
+    if (jid < 1 || jid > jobs->maxjid)
 	return NULL;
-    for (i = 0; i < MAXJOBS; i++)
-	if (jobs[i].jid == jid)
-	    return &jobs[i];
-    return NULL;
+    return jobs->byjid[jid];
 }
 
 /* pid2jid - Map process ID to job ID */
 int pid2jid(pid_t pid) 
 {
-    int i;
+    struct job_t *job = getjobpid(jobs, pid);
 
-    if (pid < 1)
-	return 0;
-    for (i = 0; i < MAXJOBS; i++)
-	if (jobs[i].pid == pid) {
-            return jobs[i].jid;
-        }
-    return 0;
+    return job ? job->jid : 0;
 }
 
 /* listjobs - Print the job list */
-void listjobs(struct job_t *jobs) 
+void listjobs(struct joblist_t *jobs) 
 {
+    struct job_t *job;
     int i;
     
-    for (i = 0; i < MAXJOBS; i++) {
-	if (jobs[i].pid != 0) {
-	    printf("[%d] (%d) ", jobs[i].jid, jobs[i].pid);
-	    switch (jobs[i].state) {
+    for (i = 1; i <= jobs->maxjid; i++) {
+	if ((job = jobs->byjid[i]) != NULL) {
+	    printf("[%d] (%d) ", job->jid, job->pid);
+	    switch (job->state) {
 		case BG: 
 		    printf("Running ");
 		    break;
@@ -569,9 +1512,9 @@ void listjobs(struct job_t *jobs)
 		    break;
 	    default:
 		    printf("listjobs: Internal error: job[%d].state=%d ", 
-			   i, jobs[i].state);
+			   i, job->state);
 	    }
-	    printf("%s", jobs[i].cmdline);
+	    printf("%s", job->cmdline);
 	}
     }
 }
@@ -580,6 +1523,155 @@ void listjobs(struct job_t *jobs)
  ******************************/
 
 
+
+/**********************************************
+ * Helper routines for the PATH command hash
+ **********************************************/
+
+/* hashname - Bucket of command name */
+static unsigned hashname(const char *name)
+{
+    unsigned h = 2166136261u;  /* FNV-1a */
+
+    while (*name)
+	h = (h ^ (unsigned char)*name++) * 16777619u;
+    return h & (HASHSIZE - 1);
+}
+
+/* 
+ * hashcmd - Search PATH for name and remember where it was found. An
+ *    empty PATH entry means the current directory. Returns NULL if no
+ *    directory on PATH has an executable name.
+ */
+struct hash_t *hashcmd(char *name)
+{
+    char *path = getenv("PATH");
+    char *dir, *end, dbuf[MAXLINE], buf[2*MAXLINE];
+    struct stat st, fst;
+    struct hash_t *h;
+    size_t len;
+
+    if (path == NULL)
+	return NULL;
+    if (hashpath == NULL || strcmp(hashpath, path)) {
+	clearhash();
+	if ((hashpath = strdup(path)) == NULL)
+	    unix_error("strdup error");
+    }
+    for (dir = hashpath; ; dir = end + 1) {
+	end = strchr(dir, ':');
+	len = end ? (size_t)(end - dir) : strlen(dir);
+	if (len == 0) {
+	    dir = ".";
+	    len = 1;
+	}
+	snprintf(dbuf, sizeof(dbuf), "%.*s", (int)len, dir);
+	snprintf(buf, sizeof(buf), "%s/%s", dbuf, name);
+	/* stat the directory first, so a change during the search
+	   leaves the entry looking stale rather than current */
+	if (stat(dbuf, &st) == 0 && access(buf, X_OK) == 0 &&
+	    stat(buf, &fst) == 0 && S_ISREG(fst.st_mode))
+	    break;
+	if (end == NULL)
+	    return NULL;
+    }
+
+    if ((h = malloc(sizeof(struct hash_t))) == NULL)
+	unix_error("malloc error");
+    h->name = strdup(name);
+    h->path = strdup(buf);
+    h->dir = strdup(dbuf);
+    if (h->name == NULL || h->path == NULL || h->dir == NULL)
+	unix_error("strdup error");
+    h->mtime = st.st_mtim;
+    h->hits = 0;
+    h->next = cmdhash[hashname(name)];
+    cmdhash[hashname(name)] = h;
+    return h;
+}
+
+/* 
+ * findcmd - Return the path to exec for command name. A name with a
+ *    slash is used as is. Otherwise the hash table answers unless the
+ *    directory it points into has changed since, in which case PATH
+ *    is searched again. A name not found on PATH is returned as is.
+ */
+char *findcmd(char *name)
+{
+    struct hash_t *h, **hp;
+    struct stat st;
+    char *path = getenv("PATH");
+
+    if (strchr(name, '/') != NULL || path == NULL)
+	return name;
+    if (hashpath != NULL && strcmp(hashpath, path))
+	clearhash();
+
+    for (hp = &cmdhash[hashname(name)]; (h = *hp) != NULL; hp = &h->next)
+	if (!strcmp(h->name, name))
+	    break;
+    if (h != NULL) {
+	if (stat(h->dir, &st) == 0 &&
+	    st.st_mtim.tv_sec == h->mtime.tv_sec &&
+	    st.st_mtim.tv_nsec == h->mtime.tv_nsec) {
+	    h->hits++;
+	    return h->path;
+	}
+	/* stale: forget it and look again */
+	*hp = h->next;
+	free(h->name);
+	free(h->path);
+	free(h->dir);
+	free(h);
+    }
+    if ((h = hashcmd(name)) == NULL)
+	return name;
+    h->hits++;
+    return h->path;
+}
+
+/* clearhash - Forget every remembered command */
+void clearhash(void)
+{
+    struct hash_t *h, *next;
+    int i;
+
+    for (i = 0; i < HASHSIZE; i++) {
+	for (h = cmdhash[i]; h != NULL; h = next) {
+	    next = h->next;
+	    free(h->name);
+	    free(h->path);
+	    free(h->dir);
+	    free(h);
+	}
+	cmdhash[i] = NULL;
+    }
+    free(hashpath);
+    hashpath = NULL;
+}
+
+/* listhash - Print the remembered commands and their hit counts */
+void listhash(void)
+{
+    struct hash_t *h;
+    int i, empty = 1;
+
+    for (i = 0; i < HASHSIZE; i++) {
+	for (h = cmdhash[i]; h != NULL; h = h->next) {
+	    if (empty)
+		printf("hits\tcommand\n");
+	    empty = 0;
+	    printf("%4d\t%s\n", h->hits, h->path);
+	}
+    }
+    if (empty)
+	printf("hash: hash table empty\n");
+}
+/**********************************************
+ * end PATH command hash helper routines
+ **********************************************/
+
+
 /***********************
  * Other helper routines
  ***********************/
@@ -589,10 +1681,11 @@ void listjobs(struct job_t *jobs)
  */
 void usage(void) 
 {
-    printf("Usage: shell [-hvp]\n");
+    printf("Usage: shell [-hvp] [-f file]\n");
     printf("   -h   print this message\n");
     printf("   -v   print additional diagnostic information\n");
     printf("   -p   do not emit a command prompt\n");
+    printf("   -f   read commands from file instead of stdin, no prompt\n");
     exit(1);
 }
 